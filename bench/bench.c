@@ -0,0 +1,675 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// bench: microbenchmarks for the DSP kernels.
+//
+// Each kernel is run over a period's worth of samples at a time, the same way dsp.c calls it, and timed 
+// with CLOCK_MONOTONIC_RAW. We report the best of several repetitions as nanoseconds per sample, 
+// GFLOP/s (where the flop count is meaningful) and the realtime factor: how many times faster than 
+// realtime the kernel runs at 44.1 and 48 kHz. A realtime factor below 1 means the kernel alone can't keep up.
+//
+// usage: bench [seconds per case]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "biquad_filt.h"
+#include "delay.h"
+#include "convolution.h"
+#include "tremolo.h"
+#include "chorusflange.h"
+#include "eq.h"
+#include "svf.h"
+#include "wah.h"
+#include "denormal.h"
+#include "multitap.h"
+#include "stereodelay.h"
+#include "ensemble.h"
+#include "modmatrix.h"
+#include "looper.h"
+#include "resample.h"
+#include "telemetry.h"
+
+#define BENCH_REPS 5
+#define BENCH_RATE 44100 // sample rate the effects are constructed with
+#define MAX_PERIOD 256
+
+static double seconds_per_case = 0.25;
+static float input[MAX_PERIOD];
+static float output[MAX_PERIOD];
+
+// a kernel processes n samples from in to out.
+typedef void (*kernel_fn)(void * state, const float * in, float * out, int n);
+
+// time fn over periods of n samples. returns nanoseconds per sample (best repetition).
+static double measure(kernel_fn fn, void * state, int n)
+{
+	// calibrate the number of periods per repetition, so that every case takes roughly the same time
+	unsigned long periods = 16;
+	while(1)
+	{
+		uint64_t t0 = telemetry_now();
+		for(unsigned long p = 0; p < periods; p++)
+			fn(state, input, output, n);
+		uint64_t dt = telemetry_now() - t0;
+		if(dt > seconds_per_case * 1e9 / BENCH_REPS / 4) 
+		{
+			periods = periods * (seconds_per_case * 1e9 / BENCH_REPS) / dt + 1;
+			break;
+		}
+		periods *= 2;
+	}
+	
+	double best = INFINITY;
+	for(int r = 0; r < BENCH_REPS; r++)
+	{
+		uint64_t t0 = telemetry_now();
+		for(unsigned long p = 0; p < periods; p++)
+			fn(state, input, output, n);
+		double ns = (double) (telemetry_now() - t0) / (periods * n);
+		if(ns < best) best = ns;
+	}
+	return best;
+}
+
+// flops: floating point operations per sample, or 0 if that isn't a meaningful measure for the kernel.
+static void report(const char * name, const char * config, double ns, double flops)
+{
+	char gflops[16] = "-";
+	if(flops > 0) snprintf(gflops, sizeof(gflops), "%.2f", flops / ns);
+	printf("%-22s %-16s %10.2f %8s %12.1f %12.1f\n", name, config, ns, gflops, 1e9 / (44100 * ns), 1e9 / (48000 * ns));
+	fflush(stdout);
+}
+
+
+
+// -- kernels --
+
+static void k_convolution(void * state, const float * in, float * out, int n)
+{
+	convolution_t * c = state;
+	memcpy(convolution_getInputPtr(c), in, n * sizeof(float));
+	convolution_apply(c, out);
+}
+
+static void k_biquad(void * state, const float * in, float * out, int n)
+{
+	for(int i = 0; i < n; i++)
+		out[i] = apply_biquad(state, in[i]);
+}
+
+// the tail of a decaying resonant filter: silent input, and the state reseeded with denormals every block
+static void k_biquad_tail(void * state, const float * in, float * out, int n)
+{
+	static const float silence[MAX_PERIOD];
+	struct bq_filter * f = state;
+	f->dly1 = 1e-39f;
+	f->dly2 = -1e-39f;
+	for(int i = 0; i < n; i++)
+		out[i] = apply_biquad(f, silence[i]);
+}
+
+// same, through the guarded feedback path version (one sample at a time, as in the chorus)
+static void k_biquad_tail_guarded(void * state, const float * in, float * out, int n)
+{
+	struct bq_filter * f = state;
+	f->dly1 = 1e-39f;
+	f->dly2 = -1e-39f;
+	for(int i = 0; i < n; i++)
+	{
+		out[i] = 0;
+		apply_biquad_generic(f, &out[i], 1);
+	}
+}
+
+static void k_biquad_block(void * state, const float * in, float * out, int n)
+{
+	apply_biquad_block(state, in, out, n);
+}
+
+// a chain of scalar biquads: state points at a struct bq_chain
+struct bq_chain
+{
+	struct bq_filter f[BQ_CASCADE_MAX];
+	int n;
+};
+
+static void k_biquad_chain(void * state, const float * in, float * out, int n)
+{
+	struct bq_chain * c = state;
+	apply_biquad_block(&c->f[0], in, out, n);
+	for(int s = 1; s < c->n; s++)
+		apply_biquad_block(&c->f[s], out, out, n);
+}
+
+static void k_biquad_cascade(void * state, const float * in, float * out, int n)
+{
+	apply_biquad_cascade(state, in, out, n);
+}
+
+// four channels of filtering: state points at a struct bq_quad. Every channel reads the same input.
+struct bq_quad
+{
+	struct bq_filter f[4];
+	bq_bank_t bank;
+	float scratch[3][MAX_PERIOD];
+};
+
+static void k_biquad_x4(void * state, const float * in, float * out, int n)
+{
+	struct bq_quad * q = state;
+	apply_biquad_block(&q->f[0], in, out, n);
+	for(int k = 1; k < 4; k++)
+		apply_biquad_block(&q->f[k], in, q->scratch[k-1], n);
+}
+
+static void k_biquad_bank(void * state, const float * in, float * out, int n)
+{
+	struct bq_quad * q = state;
+	const float * const ins[4] = {in, in, in, in};
+	float * const outs[4] = {out, q->scratch[0], q->scratch[1], q->scratch[2]};
+	apply_biquad_bank(&q->bank, ins, outs, n);
+}
+
+static void k_biquad_bank_split(void * state, const float * in, float * out, int n)
+{
+	struct bq_quad * q = state;
+	float * const outs[4] = {out, q->scratch[0], q->scratch[1], q->scratch[2]};
+	apply_biquad_bank_split(&q->bank, in, outs, n);
+}
+
+// publishes a new cutoff every block, so that the coefficients are always ramping (the worst case)
+static void k_svf(void * state, const float * in, float * out, int n)
+{
+	static int flip;
+	flip = !flip;
+	svf_set(state, BQ_LOWPASS, flip ? 2000 : 2500, 0.707, 0);
+	svf_apply_block(state, in, out, n);
+}
+
+static void k_wah(void * state, const float * in, float * out, int n)
+{
+	memcpy(out, in, n * sizeof(float));
+	wah_apply_block(state, out, n);
+}
+
+static void k_eq(void * state, const float * in, float * out, int n)
+{
+	memcpy(out, in, n * sizeof(float));
+	eq_apply(state, out, n);
+}
+
+static void k_delay(void * state, const float * in, float * out, int n)
+{
+	for(int i = 0; i < n; i++)
+		out[i] = simple_delay_apply(state, in[i]);
+}
+
+// a biquad in the delay's feedback path that the delay doesn't recognize, so it has to call it through the pointer
+static void fb_callback(void * filt, float * buf, int n)
+{
+	apply_biquad_block(filt, buf, buf, n);
+}
+
+// keeps the read head gliding back and forth between 200 and 250ms
+static void k_delay_glide(void * state, const float * in, float * out, int n)
+{
+	struct simple_delay * d = state;
+	if(!d->moving)
+		simple_delay_set_time(d, d->D > BENCH_RATE / 5 + 100 ? 200.0 : 250.0, DELAY_GLIDE);
+	memcpy(out, in, n * sizeof(float));
+	simple_delay_apply_block(d, out, n);
+}
+
+static void k_stereo_delay(void * state, const float * in, float * out, int n)
+{
+	static float right[MAX_PERIOD];
+	memcpy(out, in, n * sizeof(float));
+	memcpy(right, in, n * sizeof(float));
+	stereo_delay_apply_block(state, out, right, n);
+}
+
+static void k_ensemble(void * state, const float * in, float * out, int n)
+{
+	static float right[MAX_PERIOD];
+	memcpy(out, in, n * sizeof(float));
+	memcpy(right, in, n * sizeof(float));
+	ensemble_apply_block(state, out, right, n);
+}
+
+static void k_looper(void * state, const float * in, float * out, int n)
+{
+	memcpy(out, in, n * sizeof(float));
+	looper_apply_block(state, out, n);
+}
+
+static void k_multitap(void * state, const float * in, float * out, int n)
+{
+	static float right[MAX_PERIOD];
+	multitap_apply_block(state, in, out, right, n);
+}
+
+static void k_delay_block(void * state, const float * in, float * out, int n)
+{
+	memcpy(out, in, n * sizeof(float));
+	simple_delay_apply_block(state, out, n);
+}
+
+static void k_timemod(void * state, const float * in, float * out, int n)
+{
+	for(int i = 0; i < n; i++)
+		out[i] = timeMod_apply(state, in[i]);
+}
+
+static void k_timemod_block(void * state, const float * in, float * out, int n)
+{
+	memcpy(out, in, n * sizeof(float));
+	timeMod_apply_block(state, out, n);
+}
+
+static void k_tremolo(void * state, const float * in, float * out, int n)
+{
+	for(int i = 0; i < n; i++)
+		out[i] = tremolo_apply(state, in[i]);
+}
+
+static void k_tremolo_block(void * state, const float * in, float * out, int n)
+{
+	memcpy(out, in, n * sizeof(float));
+	tremolo_apply_block(state, out, n);
+}
+
+static void k_tremolo_stereo(void * state, const float * in, float * out, int n)
+{
+	static float right[MAX_PERIOD];
+	memcpy(out, in, n * sizeof(float));
+	memcpy(right, in, n * sizeof(float));
+	tremolo_apply_stereo(state, out, right, n);
+}
+
+static void k_modmatrix(void * state, const float * in, float * out, int n)
+{
+	modmatrix_run(state, in, n);
+}
+
+static void k_lfo(void * state, const float * in, float * out, int n)
+{
+	for(int i = 0; i < n; i++)
+		out[i] = lfo_next(state);
+}
+
+static void k_lfo_tri(void * state, const float * in, float * out, int n)
+{
+	for(int i = 0; i < n; i++)
+		out[i] = lfo_next_tri(state);
+}
+
+static void k_lfo_bank(void * state, const float * in, float * out, int n)
+{
+	static float values[LFO_BANK_MAX][MAX_PERIOD];
+	float * const o[LFO_BANK_MAX] = {out, values[1], values[2], values[3], values[4], values[5], values[6], values[7]};
+	lfo_bank_run(state, o, n);
+}
+
+static void k_resampler(void * state, const float * in, float * out, int n)
+{
+	float tmp[MAX_PERIOD + RS_MAX_EXTRA];
+	const float * rs_in[1] = {in};
+	float * rs_out[1] = {tmp};
+	int nout = resampler_process(state, rs_in, n, rs_out);
+	memcpy(out, tmp, (nout < n ? nout : n) * sizeof(float));
+}
+
+
+
+static void bench_convolution(void)
+{
+	const unsigned int ir_lengths[] = {256, 512, 1024, 1440, 2048, 4096};
+	const unsigned int periods[] = {32, 64, 128, 256};
+	
+	for(int i = 0; i < sizeof(ir_lengths)/sizeof(ir_lengths[0]); i++)
+	{
+		unsigned int n = ir_lengths[i];
+		float * IR = malloc(n * sizeof(float));
+		for(int k = 0; k < n; k++)
+			IR[k] = expf(-5.0f * k / n) * ((k * 7919) % 2 ? 1.0f : -1.0f) / n; // decaying, alternating
+		
+		for(int j = 0; j < sizeof(periods)/sizeof(periods[0]); j++)
+		{
+			convolution_t conv;
+			char * msg = NULL;
+			if(-1 == convolution_construct_ir(&conv, &msg, periods[j], IR, n))
+			{
+				printf("convolution_construct_ir: %s\n", msg);
+				exit(1);
+			}
+			char config[32];
+			snprintf(config, sizeof(config), "N=%u P=%u", n, periods[j]);
+			report("convolution_apply", config, measure(k_convolution, &conv, periods[j]), 2.0 * n);
+			convolution_destruct(&conv);
+		}
+		free(IR);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	if(argc > 1) seconds_per_case = strtod(argv[1], NULL);
+	if(seconds_per_case <= 0)
+	{
+		printf("usage: %s [seconds per case]\n", argv[0]);
+		exit(1);
+	}
+	
+	// uniform noise at a realistic level
+	srand(1);
+	for(int i = 0; i < MAX_PERIOD; i++)
+		input[i] = 0.5f * ((float) rand() / RAND_MAX - 0.5f);
+	
+	// like the realtime loop in dsp.c
+	if(-1 == denormal_ftz_set(true))
+		printf("Couldn't enable flush-to-zero: %s\n", strerror(errno));
+	
+	printf("%-22s %-16s %10s %8s %12s %12s\n", "KERNEL", "CONFIG", "ns/sample", "GFLOP/s", "RTF@44.1k", "RTF@48k");
+	
+	bench_convolution();
+	
+	const int P = 64;
+	
+	struct bq_filter bq;
+	make_biquad(&bq, BQ_LOWPASS, 2000, BENCH_RATE, 0.707);
+	report("apply_biquad", "lowpass", measure(k_biquad, &bq, P), 9);
+	report("apply_biquad_block", "lowpass", measure(k_biquad_block, &bq, P), 9);
+	
+	// what a filter costs as it dies away, with and without the denormal protection (see denormal.h)
+	struct bq_filter tail;
+	make_biquad(&tail, BQ_LOWPASS, 100, BENCH_RATE, 5.0);
+	if(0 == denormal_ftz_set(false))
+	{
+		report("biquad decay tail", "unprotected", measure(k_biquad_tail, &tail, P), 0);
+		report("biquad decay tail", "guarded", measure(k_biquad_tail_guarded, &tail, P), 0);
+		denormal_ftz_set(true);
+	}
+	report("biquad decay tail", "flush-to-zero", measure(k_biquad_tail, &tail, P), 0);
+	
+	const int nsections[] = {4, 8, 16};
+	for(int i = 0; i < sizeof(nsections)/sizeof(nsections[0]); i++)
+	{
+		struct bq_chain chain;
+		chain.n = nsections[i];
+		for(int s = 0; s < chain.n; s++)
+			make_biquad(&chain.f[s], BQ_LOWPASS, 1000 + 500 * s, BENCH_RATE, 0.707);
+		bq_cascade_t cascade;
+		make_biquad_cascade(&cascade, chain.f, chain.n);
+		
+		char config[32];
+		snprintf(config, sizeof(config), "%d sections", chain.n);
+		report("biquad chain (block)", config, measure(k_biquad_chain, &chain, P), 9.0 * chain.n);
+		report("apply_biquad_cascade", config, measure(k_biquad_cascade, &cascade, P), 9.0 * chain.n);
+	}
+	
+	struct bq_quad quad;
+	for(int k = 0; k < 4; k++)
+		make_biquad(&quad.f[k], BQ_BANDPASS, 250 << k, BENCH_RATE, 1.0);
+	make_biquad_bank(&quad.bank, quad.f, 4);
+	report("4x apply_biquad_block", "4 channels", measure(k_biquad_x4, &quad, P), 36);
+	report("apply_biquad_bank", "4 channels", measure(k_biquad_bank, &quad, P), 36);
+	report("bank_split", "4 bands", measure(k_biquad_bank_split, &quad, P), 36);
+	
+	struct eq_band bands[EQ_MAX_BANDS];
+	for(int k = 0; k < EQ_MAX_BANDS; k++)
+		bands[k] = (struct eq_band) {EQ_PEAK, 40 << k, 1.0, (k & 1) ? 3.0 : -3.0};
+	eq_t eq;
+	if(-1 == eq_construct(&eq, BENCH_RATE, bands, EQ_MAX_BANDS))
+	{
+		printf("eq_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	report("eq_apply", "10 bands", measure(k_eq, &eq, P), 9.0 * EQ_MAX_BANDS);
+	
+	svf_t svf;
+	svf_construct(&svf, BQ_LOWPASS, 2000, BENCH_RATE, 0.707, 0);
+	report("svf_apply_block", "lowpass, swept", measure(k_svf, &svf, P), 0);
+	
+	const char * wah_modes[] = {"fixed", "lfo", "envelope"};
+	for(int m = WAH_FIXED; m <= WAH_ENVELOPE; m++)
+	{
+		wah_t wah;
+		if(-1 == wah_construct(&wah, BENCH_RATE, m, 1.0))
+		{
+			printf("wah_construct: %s\n", strerror(errno));
+			exit(1);
+		}
+		report("wah_apply_block", wah_modes[m], measure(k_wah, &wah, P), 0);
+		wah_destruct(&wah);
+	}
+	
+	struct bq_filter dlyLPF;
+	make_biquad(&dlyLPF, BQ_LOWPASS, 2000, BENCH_RATE, 0.707);
+	struct simple_delay dly;
+	if(-1 == simple_delay_construct(&dly, 0.3, 0.3, BENCH_RATE, 250.0, &apply_biquad_generic, &dlyLPF))
+	{
+		printf("simple_delay_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	report("simple_delay_apply", "250ms + biquad", measure(k_delay, &dly, P), 0);
+	simple_delay_destruct(&dly);
+	
+	// the block version, for each of the specialized feedback paths, and the generic callback path
+	const fdbk_fn_t fb_fns[] = {NULL, &apply_biquad_generic, &delay_fb_biquad_sat, &fb_callback};
+	const char * fb_names[] = {"250ms", "250ms + biquad", "250ms + bq + sat", "250ms + callback"};
+	for(int i = 0; i < 4; i++)
+	{
+		if(-1 == simple_delay_construct(&dly, 0.3, 0.3, BENCH_RATE, 250.0, fb_fns[i], &dlyLPF))
+		{
+			printf("simple_delay_construct: %s\n", strerror(errno));
+			exit(1);
+		}
+		report("simple_delay (block)", fb_names[i], measure(k_delay_block, &dly, P), 0);
+		simple_delay_destruct(&dly);
+	}
+	
+	const char * interp_names[] = {"linear", "lagrange3", "thiran", "hermite"}; // (indexed by INTERP_ constant)
+	for(int i = INTERP_LINEAR; i <= INTERP_HERMITE; i++)
+	{
+		if(-1 == simple_delay_construct(&dly, 0.3, 0.3, BENCH_RATE, 250.0, &apply_biquad_generic, &dlyLPF))
+		{
+			printf("simple_delay_construct: %s\n", strerror(errno));
+			exit(1);
+		}
+		simple_delay_set_interp(&dly, i);
+		char config[32];
+		snprintf(config, sizeof(config), "glide, %s", interp_names[i]);
+		report("simple_delay (block)", config, measure(k_delay_glide, &dly, P), 0);
+		simple_delay_destruct(&dly);
+	}
+	
+	stereo_delay_t sdly;
+	if(-1 == stereo_delay_construct(&sdly, BENCH_RATE, STEREO_DELAY_PINGPONG, 250.0, 375.0, 0.4, 0.0, 0.4, 1.0, &dlyLPF))
+	{
+		printf("stereo_delay_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	report("stereo_delay", "ping-pong + bq", measure(k_stereo_delay, &sdly, P), 0);
+	stereo_delay_destruct(&sdly);
+	
+	const int nvoices[] = {1, 2, 4, 8};
+	for(int i = 0; i < 4; i++)
+	{
+		struct ens_voice v[ENS_MAX_VOICES];
+		ensemble_voices(v, nvoices[i], 15.0, 3.0, 0.6, 0.8);
+		ensemble_t ens;
+		if(-1 == ensemble_construct(&ens, BENCH_RATE, v, nvoices[i], 0.5))
+		{
+			printf("ensemble_construct: %s\n", strerror(errno));
+			exit(1);
+		}
+		char config[32];
+		snprintf(config, sizeof(config), "%d voice%s", nvoices[i], nvoices[i] > 1 ? "s" : "");
+		report("ensemble_apply_block", config, measure(k_ensemble, &ens, P), 0);
+		if(nvoices[i] == 4)
+		{
+			for(int t = INTERP_LINEAR; t <= INTERP_HERMITE; t++)
+			{
+				if(t == INTERP_LAGRANGE3 || -1 == ensemble_set_interp(&ens, t)) // (the default, measured above; the allpass isn't supported)
+					continue;
+				snprintf(config, sizeof(config), "4 voices %s", interp_names[t]);
+				report("ensemble_apply_block", config, measure(k_ensemble, &ens, P), 0);
+			}
+		}
+		ensemble_destruct(&ens);
+	}
+	
+	// (the I/O thread runs alongside, as it would in dsp)
+	looper_t lp;
+	if(-1 == looper_construct(&lp, BENCH_RATE, 60, "/tmp/guitardsp-bench-loop"))
+	{
+		printf("looper_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	report("looper_apply_block", "empty", measure(k_looper, &lp, P), 0);
+	looper_command(&lp, LOOPER_RECORD);
+	for(int i = 0; i < 2 * BENCH_RATE / P; i++)
+	{
+		k_looper(&lp, input, output, P);
+		usleep(100);
+	}
+	looper_command(&lp, LOOPER_OVERDUB);
+	report("looper_apply_block", "overdub 2 s loop", measure(k_looper, &lp, P), 0);
+	looper_destruct(&lp);
+	
+	const int ntaps[] = {1, 4, 8};
+	for(int i = 0; i < 3; i++)
+	{
+		struct mt_tap taps[MT_MAX_TAPS];
+		for(int t = 0; t < ntaps[i]; t++)
+			taps[t] = (struct mt_tap) {.beats = 0.25 * (t + 1), .gain = 0.5, .pan = (t & 1) ? 0.5 : -0.5, 
+				.filter_type = BQ_LOWPASS, .filter_freq = 2000 + 500 * t};
+		multitap_t mt;
+		if(-1 == multitap_construct(&mt, BENCH_RATE, 2000.0, taps, ntaps[i], 120.0, 0.3, 0.5))
+		{
+			printf("multitap_construct: %s\n", strerror(errno));
+			exit(1);
+		}
+		char config[32];
+		snprintf(config, sizeof(config), "%d taps, filtered", ntaps[i]);
+		report("multitap_apply_block", config, measure(k_multitap, &mt, P), 0);
+		multitap_destruct(&mt);
+	}
+	
+	timeMod_t mod;
+	struct bq_filter cfLPF;
+	make_biquad(&cfLPF, BQ_LOWPASS, 2000, BENCH_RATE, 0.707);
+	if(-1 == timeMod_construct(&mod, BENCH_RATE, 1.0, 0.2, 0.0, 5.0, lfo(BENCH_RATE, 1.0)))
+	{
+		printf("timeMod_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	mod.bq = &cfLPF;
+	report("timeMod_apply", "5ms + biquad", measure(k_timemod, &mod, P), 0);
+	report("timeMod_apply_block", "5ms + biquad", measure(k_timemod_block, &mod, P), 0);
+	for(int i = INTERP_LAGRANGE3; i <= INTERP_HERMITE; i++)
+	{
+		if(-1 == timeMod_set_interp(&mod, i)) // (the allpass isn't supported)
+			continue;
+		char config[32];
+		snprintf(config, sizeof(config), "5ms+bq %s", interp_names[i]);
+		report("timeMod_apply_block", config, measure(k_timemod_block, &mod, P), 0);
+	}
+	timeMod_destruct(&mod);
+	if(-1 == timeMod_construct(&mod, BENCH_RATE, 1.0, 0.9, 0.5, 2.0, lfo(BENCH_RATE, 0.3)))
+	{
+		printf("timeMod_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	report("timeMod_apply", "flanger, fb 0.5", measure(k_timemod, &mod, P), 0);
+	report("timeMod_apply_block", "flanger, fb 0.5", measure(k_timemod_block, &mod, P), 0);
+	timeMod_destruct(&mod);
+	
+	tremolo_t trem;
+	tremolo_construct(&trem, BENCH_RATE, 0.4, lfo(BENCH_RATE, 3.5));
+	report("tremolo_apply", "", measure(k_tremolo, &trem, P), 0);
+	const char * trem_modes[] = {"classic", "harmonic", "auto-pan"};
+	for(int m = TREM_CLASSIC; m <= TREM_AUTOPAN; m++)
+	{
+		tremolo_set_mode(&trem, m);
+		if(m != TREM_AUTOPAN)
+			report("tremolo_apply_block", trem_modes[m], measure(k_tremolo_block, &trem, P), 0);
+		report("tremolo_apply_stereo", trem_modes[m], measure(k_tremolo_stereo, &trem, P), 0);
+	}
+	tremolo_set_mode(&trem, TREM_CLASSIC);
+	
+	// three LFOs, the envelope and the pedal, into three destinations
+	modmatrix_t mm;
+	if(-1 == modmatrix_construct(&mm, BENCH_RATE, 16, MOD_RAMP_SMOOTH))
+	{
+		printf("modmatrix_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	for(int k = 0; k < 3; k++)
+	{
+		modmatrix_add_lfo(&mm, k, 0.5 + k, 0);
+		modmatrix_add_dest(&mm, 0.5, 0, 1);
+		modmatrix_route(&mm, k, k, 0.2);
+	}
+	modmatrix_route(&mm, MOD_SRC_ENVELOPE, 0, -0.5);
+	modmatrix_route(&mm, MOD_SRC_PEDAL, 1, 0.5);
+	report("modmatrix_run", "ctrl 16", measure(k_modmatrix, &mm, P), 0);
+	trem.depth_mod = modmatrix_dest(&mm, 0);
+	report("tremolo_apply_block", "depth_mod", measure(k_tremolo_block, &trem, P), 0);
+	modmatrix_destruct(&mm);
+	
+	lfo_t l = lfo(BENCH_RATE, 3.5);
+	report("lfo_next", "", measure(k_lfo, &l, P), 0);
+	l = lfo(BENCH_RATE, 3.5);
+	report("lfo_next_tri", "", measure(k_lfo_tri, &l, P), 0);
+	
+	// (all the LFOs together, per sample)
+	const int nlfos[] = {4, 8};
+	for(int i = 0; i < 2; i++)
+	{
+		lfo_bank_t bank;
+		if(-1 == lfo_bank_construct(&bank, BENCH_RATE))
+		{
+			printf("lfo_bank_construct: %s\n", strerror(errno));
+			exit(1);
+		}
+		for(int k = 0; k < nlfos[i]; k++)
+			lfo_bank_add(&bank, k % LFO_SHAPES, 0.5 + k, 0.1 * k);
+		char config[32];
+		snprintf(config, sizeof(config), "%d LFOs", nlfos[i]);
+		report("lfo_bank_run", config, measure(k_lfo_bank, &bank, P), 0);
+		lfo_bank_destruct(&bank);
+	}
+	
+	resampler_t rs;
+	if(-1 == resampler_construct(&rs, 1, P))
+	{
+		printf("resampler_construct: %s\n", strerror(errno));
+		exit(1);
+	}
+	rs.ratio = 1.0001;
+	report("resampler_process", "mono", measure(k_resampler, &rs, P), 4.0 * RS_TAPS);
+	resampler_destruct(&rs);
+	
+	return 0;
+}
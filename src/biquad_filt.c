@@ -16,28 +16,38 @@
 	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "biquad_filt.h"
+#include "denormal.h"
+#include "simd.h"
 #include <errno.h>
 #include <math.h>
+#include <string.h>
 
 
 float apply_biquad(struct bq_filter * filt, float sample)
 {
-	float w,y;
-	w =  -filt->dly1 * filt->cy1;
-	w -=  filt->dly2 * filt->cy2;
-	w +=  sample;
-	y =   filt->dly1 * filt->cx1;
-	y +=  filt->dly2 * filt->cx2;
-	y +=  w * filt->cx0;
-	filt->dly2 = filt->dly1;
-	filt->dly1 = w;
-   
-	return y;
+	return biquad_tick(filt, sample);
+}
+
+void apply_biquad_block(struct bq_filter * filt, const float * in, float * out, int n)
+{
+	const float b0 = filt->cx0, b1 = filt->cx1, b2 = filt->cx2, a1 = filt->cy1, a2 = filt->cy2;
+	float s1 = filt->dly1, s2 = filt->dly2;
+	for(int i = 0; i < n; i++)
+	{
+		float x = in[i];
+		float y = b0 * x + s1;
+		s1 = b1 * x - a1 * y + s2;
+		s2 = b2 * x - a2 * y;
+		out[i] = y;
+	}
+	// guard against the state decaying into denormals once the input goes quiet (once per block is enough)
+	filt->dly1 = denormal_flush(s1);
+	filt->dly2 = denormal_flush(s2);
 }
 
-float apply_biquad_generic(void * filt, float sample)
+void apply_biquad_generic(void * filt, float * buf, int n)
 {
-	return apply_biquad((struct bq_filter *) filt, sample);
+	apply_biquad_block((struct bq_filter *) filt, buf, buf, n);
 }
 
 
@@ -89,3 +99,377 @@ int make_biquad(struct bq_filter * output, int type, float freq_cutoff, float sa
 	
 	return 0;
 }
+
+// These are the formulas from Robert Bristow-Johnson's "Audio EQ cookbook".
+int make_biquad_gain(struct bq_filter * output, int type, float freq, float sample_rate, float Q, float gain_db)
+{
+	if(type != BQ_PEAK && type != BQ_LOWSHELF && type != BQ_HIGHSHELF)
+		return make_biquad(output, type, freq, sample_rate, Q);
+	
+	if(Q <= 0 || freq <= 0 || freq >= sample_rate / 2)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	double A = pow(10.0, gain_db / 40.0);
+	double w0 = 2 * M_PI * freq / sample_rate;
+	double cw = cos(w0);
+	double alpha = sin(w0) / (2 * Q);
+	double sq = 2 * sqrt(A) * alpha;
+	double b0, b1, b2, a0, a1, a2;
+	
+	switch(type)
+	{
+		case BQ_PEAK:
+			b0 = 1 + alpha * A;
+			b1 = -2 * cw;
+			b2 = 1 - alpha * A;
+			a0 = 1 + alpha / A;
+			a1 = -2 * cw;
+			a2 = 1 - alpha / A;
+			break;
+		case BQ_LOWSHELF:
+			b0 = A * ((A+1) - (A-1) * cw + sq);
+			b1 = 2 * A * ((A-1) - (A+1) * cw);
+			b2 = A * ((A+1) - (A-1) * cw - sq);
+			a0 = (A+1) + (A-1) * cw + sq;
+			a1 = -2 * ((A-1) + (A+1) * cw);
+			a2 = (A+1) + (A-1) * cw - sq;
+			break;
+		default: // BQ_HIGHSHELF
+			b0 = A * ((A+1) + (A-1) * cw + sq);
+			b1 = -2 * A * ((A-1) + (A+1) * cw);
+			b2 = A * ((A+1) + (A-1) * cw - sq);
+			a0 = (A+1) - (A-1) * cw + sq;
+			a1 = 2 * ((A-1) - (A+1) * cw);
+			a2 = (A+1) - (A-1) * cw - sq;
+			break;
+	}
+	
+	output->cx0 = b0 / a0;
+	output->cx1 = b1 / a0;
+	output->cx2 = b2 / a0;
+	output->cy1 = a1 / a0;
+	output->cy2 = a2 / a0;
+	output->dly1 = 0;
+	output->dly2 = 0;
+	return 0;
+}
+
+
+
+int make_biquad_cascade(bq_cascade_t * output, const struct bq_filter * sections, int n)
+{
+	if(n < 1 || n > BQ_CASCADE_MAX)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	output->nsections = n;
+	output->ngroups = (n + 3) / 4;
+	
+	for(int g = 0; g < output->ngroups; g++)
+	{
+		// unused lanes in the last group pass their input straight through
+		float b0[4] = {1, 1, 1, 1}, b1[4] = {0}, b2[4] = {0}, a1[4] = {0}, a2[4] = {0}, s1[4] = {0}, s2[4] = {0};
+		for(int k = 0; k < 4 && 4*g + k < n; k++)
+		{
+			const struct bq_filter * f = &sections[4*g + k];
+			b0[k] = f->cx0;
+			b1[k] = f->cx1;
+			b2[k] = f->cx2;
+			a1[k] = -f->cy1;
+			a2[k] = -f->cy2;
+			s1[k] = f->dly1;
+			s2[k] = f->dly2;
+		}
+		output->b0[g] = vld1q_f32(b0);
+		output->b1[g] = vld1q_f32(b1);
+		output->b2[g] = vld1q_f32(b2);
+		output->a1[g] = vld1q_f32(a1);
+		output->a2[g] = vld1q_f32(a2);
+		output->s1[g] = vld1q_f32(s1);
+		output->s2[g] = vld1q_f32(s2);
+	}
+	return 0;
+}
+
+// One step of the pipeline: lane k takes lane k-1's previous output (lane 0 takes x), and all four 
+// sections advance by one sample. y holds the sections' outputs.
+static inline void cascade_step(float32x4_t x, float32x4_t * y, 
+	float32x4_t b0, float32x4_t b1, float32x4_t b2, float32x4_t a1, float32x4_t a2, 
+	float32x4_t * s1, float32x4_t * s2)
+{
+	float32x4_t in = vextq_f32(x, *y, 3); // {x, y0, y1, y2}
+	float32x4_t out = vfmaq_f32(*s1, b0, in);
+	*s1 = vfmaq_f32(vfmaq_f32(*s2, b1, in), a1, out);
+	*s2 = vfmaq_f32(vmulq_f32(b2, in), a2, out);
+	*y = out;
+}
+
+// apply one group of four sections. Needs n >= 3.
+static void cascade_group(bq_cascade_t * c, int g, const float * in, float * out, int n)
+{
+	const float32x4_t b0 = c->b0[g], b1 = c->b1[g], b2 = c->b2[g], a1 = c->a1[g], a2 = c->a2[g];
+	float32x4_t s1 = c->s1[g], s2 = c->s2[g];
+	float32x4_t y = vmovq_n_f32(0.0f);
+	
+	// At step t, lane k processes sample t-k. During the first and last three steps some lanes have no 
+	// sample to work on, and must keep their state as it is.
+	static const uint32_t fill[3][4] = {{~0u, 0, 0, 0}, {~0u, ~0u, 0, 0}, {~0u, ~0u, ~0u, 0}};
+	static const uint32_t drain[3][4] = {{0, ~0u, ~0u, ~0u}, {0, 0, ~0u, ~0u}, {0, 0, 0, ~0u}};
+	
+	for(int t = 0; t < 3; t++)
+	{
+		float32x4_t s1o = s1, s2o = s2;
+		cascade_step(vdupq_n_f32(in[t]), &y, b0, b1, b2, a1, a2, &s1, &s2);
+		uint32x4_t m = vld1q_u32(fill[t]);
+		s1 = vbslq_f32(m, s1, s1o);
+		s2 = vbslq_f32(m, s2, s2o);
+	}
+	
+	// steady state: all four lanes busy
+	for(int t = 3; t < n; t++)
+	{
+		cascade_step(vdupq_n_f32(in[t]), &y, b0, b1, b2, a1, a2, &s1, &s2);
+		out[t - 3] = vgetq_lane_f32(y, 3);
+	}
+	
+	for(int t = 0; t < 3; t++)
+	{
+		float32x4_t s1o = s1, s2o = s2;
+		cascade_step(vmovq_n_f32(0.0f), &y, b0, b1, b2, a1, a2, &s1, &s2);
+		uint32x4_t m = vld1q_u32(drain[t]);
+		s1 = vbslq_f32(m, s1, s1o);
+		s2 = vbslq_f32(m, s2, s2o);
+		out[n - 3 + t] = vgetq_lane_f32(y, 3);
+	}
+	
+	c->s1[g] = denormal_flushq(s1);
+	c->s2[g] = denormal_flushq(s2);
+}
+
+void apply_biquad_cascade(bq_cascade_t * c, const float * in, float * out, int n)
+{
+	if(n < 3)
+	{
+		// too short to fill the pipeline. Run the sections one after the other.
+		float tmp[3];
+		memcpy(tmp, in, n * sizeof(float));
+		for(int s = 0; s < c->nsections; s++)
+		{
+			int g = s / 4, k = s % 4;
+			float cf[7][4];
+			vst1q_f32(cf[0], c->b0[g]); vst1q_f32(cf[1], c->b1[g]); vst1q_f32(cf[2], c->b2[g]);
+			vst1q_f32(cf[3], c->a1[g]); vst1q_f32(cf[4], c->a2[g]);
+			vst1q_f32(cf[5], c->s1[g]); vst1q_f32(cf[6], c->s2[g]);
+			struct bq_filter f = {cf[0][k], cf[1][k], cf[2][k], -cf[3][k], -cf[4][k], cf[5][k], cf[6][k]};
+			apply_biquad_block(&f, tmp, tmp, n);
+			cf[5][k] = f.dly1;
+			cf[6][k] = f.dly2;
+			c->s1[g] = vld1q_f32(cf[5]);
+			c->s2[g] = vld1q_f32(cf[6]);
+		}
+		memcpy(out, tmp, n * sizeof(float));
+		return;
+	}
+	
+	cascade_group(c, 0, in, out, n);
+	for(int g = 1; g < c->ngroups; g++)
+		cascade_group(c, g, out, out, n);
+}
+
+
+
+int make_biquad_lut(bq_lut_t * output, int type, float sample_rate, float fmin, float fmax, float qmin, float qmax, float gain_db)
+{
+	if(fmin <= 0 || fmax <= fmin || fmax >= sample_rate / 2 || qmin <= 0 || qmax < qmin)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	output->fmin = fmin;
+	output->fmax = fmax;
+	output->qmin = qmin;
+	output->qmax = qmax;
+	for(int q = 0; q < BQ_LUT_QS; q++)
+	{
+		float Q = qmin * powf(qmax / qmin, (float) q / (BQ_LUT_QS - 1));
+		for(int f = 0; f < BQ_LUT_FREQS; f++)
+		{
+			float freq = fmin * powf(fmax / fmin, (float) f / (BQ_LUT_FREQS - 1));
+			struct bq_filter filt;
+			if(-1 == make_biquad_gain(&filt, type, freq, sample_rate, Q, gain_db))
+				return -1;
+			output->c[q][f][0] = filt.cx0;
+			output->c[q][f][1] = filt.cx1;
+			output->c[q][f][2] = filt.cx2;
+			output->c[q][f][3] = filt.cy1;
+			output->c[q][f][4] = filt.cy2;
+		}
+	}
+	return 0;
+}
+
+void biquad_lut_set(const bq_lut_t * lut, struct bq_filter * filt, float fpos, float qpos)
+{
+	fpos = fpos < 0 ? 0 : fpos > 1 ? 1 : fpos;
+	qpos = qpos < 0 ? 0 : qpos > 1 ? 1 : qpos;
+	
+	// cell and fractional position within it, on both axes. The last cell is clamped so that f+1 and q+1 exist.
+	float x = fpos * (BQ_LUT_FREQS - 1);
+	float y = qpos * (BQ_LUT_QS - 1);
+	int f = (int) x;
+	int q = (int) y;
+	if(f > BQ_LUT_FREQS - 2) f = BQ_LUT_FREQS - 2;
+	if(q > BQ_LUT_QS - 2) q = BQ_LUT_QS - 2;
+	float fx = x - f;
+	float fy = y - q;
+	
+	const float * c00 = lut->c[q][f];
+	const float * c01 = lut->c[q][f+1];
+	const float * c10 = lut->c[q+1][f];
+	const float * c11 = lut->c[q+1][f+1];
+	float c[5];
+	for(int k = 0; k < 5; k++)
+	{
+		float lo = c00[k] + fx * (c01[k] - c00[k]);
+		float hi = c10[k] + fx * (c11[k] - c10[k]);
+		c[k] = lo + fy * (hi - lo);
+	}
+	filt->cx0 = c[0];
+	filt->cx1 = c[1];
+	filt->cx2 = c[2];
+	filt->cy1 = c[3];
+	filt->cy2 = c[4];
+}
+
+float biquad_lut_fpos(const bq_lut_t * lut, float freq)
+{
+	return logf(freq / lut->fmin) / logf(lut->fmax / lut->fmin);
+}
+
+void bq_cascade_lerp(bq_cascade_t * c, const bq_cascade_t * target, float t)
+{
+	for(int g = 0; g < c->ngroups; g++)
+	{
+		c->b0[g] = vfmaq_f32(c->b0[g], vsubq_f32(target->b0[g], c->b0[g]), vdupq_n_f32(t));
+		c->b1[g] = vfmaq_f32(c->b1[g], vsubq_f32(target->b1[g], c->b1[g]), vdupq_n_f32(t));
+		c->b2[g] = vfmaq_f32(c->b2[g], vsubq_f32(target->b2[g], c->b2[g]), vdupq_n_f32(t));
+		c->a1[g] = vfmaq_f32(c->a1[g], vsubq_f32(target->a1[g], c->a1[g]), vdupq_n_f32(t));
+		c->a2[g] = vfmaq_f32(c->a2[g], vsubq_f32(target->a2[g], c->a2[g]), vdupq_n_f32(t));
+	}
+}
+
+
+
+int make_biquad_bank(bq_bank_t * output, const struct bq_filter * filters, int n)
+{
+	if(n < 1 || n > 4)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	float b0[4] = {0}, b1[4] = {0}, b2[4] = {0}, a1[4] = {0}, a2[4] = {0}, s1[4] = {0}, s2[4] = {0};
+	for(int k = 0; k < n; k++)
+	{
+		b0[k] = filters[k].cx0;
+		b1[k] = filters[k].cx1;
+		b2[k] = filters[k].cx2;
+		a1[k] = -filters[k].cy1;
+		a2[k] = -filters[k].cy2;
+		s1[k] = filters[k].dly1;
+		s2[k] = filters[k].dly2;
+	}
+	output->b0 = vld1q_f32(b0);
+	output->b1 = vld1q_f32(b1);
+	output->b2 = vld1q_f32(b2);
+	output->a1 = vld1q_f32(a1);
+	output->a2 = vld1q_f32(a2);
+	output->s1 = vld1q_f32(s1);
+	output->s2 = vld1q_f32(s2);
+	return 0;
+}
+
+// advance all four filters by one sample. x holds one sample per lane.
+static inline float32x4_t bank_step(bq_bank_t * b, float32x4_t x, float32x4_t * s1, float32x4_t * s2)
+{
+	float32x4_t y = vfmaq_f32(*s1, b->b0, x);
+	*s1 = vfmaq_f32(vfmaq_f32(*s2, b->b1, x), b->a1, y);
+	*s2 = vfmaq_f32(vmulq_f32(b->b2, x), b->a2, y);
+	return y;
+}
+
+void apply_biquad_bank(bq_bank_t * b, const float * const in[4], float * const out[4], int n)
+{
+	float32x4_t s1 = b->s1, s2 = b->s2;
+	const float32x4_t zero = vmovq_n_f32(0.0f);
+	int i = 0;
+	
+	// four samples at a time: load four samples of each channel, transpose so that each vector holds 
+	// one sample of every channel, run the filters, and transpose back.
+	for(; i + 4 <= n; i += 4)
+	{
+		float32x4_t r0 = in[0] ? vld1q_f32(in[0] + i) : zero;
+		float32x4_t r1 = in[1] ? vld1q_f32(in[1] + i) : zero;
+		float32x4_t r2 = in[2] ? vld1q_f32(in[2] + i) : zero;
+		float32x4_t r3 = in[3] ? vld1q_f32(in[3] + i) : zero;
+		transpose4(&r0, &r1, &r2, &r3);
+		r0 = bank_step(b, r0, &s1, &s2);
+		r1 = bank_step(b, r1, &s1, &s2);
+		r2 = bank_step(b, r2, &s1, &s2);
+		r3 = bank_step(b, r3, &s1, &s2);
+		transpose4(&r0, &r1, &r2, &r3);
+		if(out[0]) vst1q_f32(out[0] + i, r0);
+		if(out[1]) vst1q_f32(out[1] + i, r1);
+		if(out[2]) vst1q_f32(out[2] + i, r2);
+		if(out[3]) vst1q_f32(out[3] + i, r3);
+	}
+	
+	for(; i < n; i++)
+	{
+		float x[4], y[4];
+		for(int k = 0; k < 4; k++)
+			x[k] = in[k] ? in[k][i] : 0.0f;
+		vst1q_f32(y, bank_step(b, vld1q_f32(x), &s1, &s2));
+		for(int k = 0; k < 4; k++)
+			if(out[k]) out[k][i] = y[k];
+	}
+	
+	b->s1 = denormal_flushq(s1);
+	b->s2 = denormal_flushq(s2);
+}
+
+void apply_biquad_bank_split(bq_bank_t * b, const float * in, float * const out[4], int n)
+{
+	float32x4_t s1 = b->s1, s2 = b->s2;
+	int i = 0;
+	
+	for(; i + 4 <= n; i += 4)
+	{
+		float32x4_t r0 = bank_step(b, vdupq_n_f32(in[i]), &s1, &s2);
+		float32x4_t r1 = bank_step(b, vdupq_n_f32(in[i+1]), &s1, &s2);
+		float32x4_t r2 = bank_step(b, vdupq_n_f32(in[i+2]), &s1, &s2);
+		float32x4_t r3 = bank_step(b, vdupq_n_f32(in[i+3]), &s1, &s2);
+		transpose4(&r0, &r1, &r2, &r3);
+		if(out[0]) vst1q_f32(out[0] + i, r0);
+		if(out[1]) vst1q_f32(out[1] + i, r1);
+		if(out[2]) vst1q_f32(out[2] + i, r2);
+		if(out[3]) vst1q_f32(out[3] + i, r3);
+	}
+	
+	for(; i < n; i++)
+	{
+		float y[4];
+		vst1q_f32(y, bank_step(b, vdupq_n_f32(in[i]), &s1, &s2));
+		for(int k = 0; k < 4; k++)
+			if(out[k]) out[k][i] = y[k];
+	}
+	
+	b->s1 = denormal_flushq(s1);
+	b->s2 = denormal_flushq(s2);
+}
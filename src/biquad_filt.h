@@ -19,7 +19,10 @@
 #define BIQUAD_FILT_H
 
 // This file and the associated .c contain a simple biquad filter implementation.
-// The filter contains it's state in the following struct, and operates on one sample at a time.
+// The filter contains it's state in the following struct, and operates on one sample at a time, or a block at a time.
+// The filters are implemented in transposed direct form II, which behaves better than direct form II in floating point.
+
+#include <arm_neon.h>
 
 struct bq_filter
 {
@@ -28,7 +31,7 @@ struct bq_filter
 	float cx2;
 	float cy1;
 	float cy2;
-	float dly1;
+	float dly1; // transposed direct form II state
 	float dly2;
 };
 
@@ -37,16 +40,133 @@ struct bq_filter
 #define BQ_HIGHPASS 2
 #define BQ_BANDPASS 3
 #define BQ_NOTCH 4
+// these take a gain, see make_biquad_gain
+#define BQ_PEAK 5
+#define BQ_LOWSHELF 6
+#define BQ_HIGHSHELF 7
 
 // returns 0 on OK, or -1 on error (and sets errno - most likely EINVAL if type is wrong).
 // type should be one of the above defines
 int make_biquad(struct bq_filter * output, int type, float freq_cutoff, float sample_rate, float Q);
 
+// same as make_biquad, but for the filters that boost or cut (BQ_PEAK, BQ_LOWSHELF, BQ_HIGHSHELF), by gain_db.
+// For the peaking filter freq is the centre frequency, for the shelves it's the midpoint of the transition. 
+// For the shelves Q sets the steepness of the slope; 0.707 is the steepest without overshoot.
+// The other types are passed on to make_biquad, and gain_db is ignored.
+int make_biquad_gain(struct bq_filter * output, int type, float freq, float sample_rate, float Q, float gain_db);
+
 // apply the filter to the next sample.
 float apply_biquad(struct bq_filter * filt, float sample);
 
-// a version of the above that is genericized
+// the same thing inline, for use inside other effects' loops. Copy the filter to a local variable first 
+// (and back afterwards) so that the compiler can keep it in registers.
+static inline float biquad_tick(struct bq_filter * f, float x)
+{
+	float y = f->cx0 * x + f->dly1;
+	f->dly1 = f->cx1 * x - f->cy1 * y + f->dly2;
+	f->dly2 = f->cx2 * x - f->cy2 * y;
+	return y;
+}
+
+// a version of apply_biquad_block that is genericized (filters buf in place)
 // used as a callback in, for example, the delay effect.
-float apply_biquad_generic(void * filt, float sample);
+void apply_biquad_generic(void * filt, float * buf, int n);
+
+// apply the filter to n samples. in and out may be the same buffer.
+// Equivalent to calling apply_biquad on each sample, but the state stays in registers for the whole block.
+void apply_biquad_block(struct bq_filter * filt, const float * in, float * out, int n);
+
+
+
+// A table of precomputed coefficients for one filter type over a range of frequencies and Qs, for filters that 
+// are swept while running (e.g. a wah). Looking up a filter costs a couple of dozen multiply-adds, 
+// instead of the trig and divisions in make_biquad.
+// Both axes are logarithmic, and addressed by a position from 0 to 1: 0 is fmin (or qmin), 1 is fmax (or qmax).
+// In between, the coefficients are interpolated; every filter on a straight line between two stable filters is 
+// stable too, so the result is always stable.
+
+#define BQ_LUT_FREQS 128
+#define BQ_LUT_QS 8
+
+typedef struct bq_lut
+{
+	float c[BQ_LUT_QS][BQ_LUT_FREQS][5]; // cx0, cx1, cx2, cy1, cy2
+	float fmin, fmax, qmin, qmax;
+} bq_lut_t;
+
+// build the table for one of the BQ_ types (gain_db is only used by BQ_PEAK, BQ_LOWSHELF and BQ_HIGHSHELF). 
+// Tables are specific to the sample rate. fmax must be below half the sample rate.
+// returns 0 on OK, or -1 on error (and sets errno, EINVAL).
+int make_biquad_lut(bq_lut_t * output, int type, float sample_rate, float fmin, float fmax, float qmin, float qmax, float gain_db);
+
+// set filt's coefficients from the table, keeping its state. fpos and qpos are clamped to 0..1.
+void biquad_lut_set(const bq_lut_t * lut, struct bq_filter * filt, float fpos, float qpos);
+
+// position of freq on the frequency axis of the table (not clamped). Uses logf, so it's best kept out of inner loops.
+float biquad_lut_fpos(const bq_lut_t * lut, float freq);
+
+
+
+// A cascade of biquad sections (second order sections), e.g. for a high order EQ or a crossover.
+// The sections are processed four at a time, one per SIMD lane: at each step, lane k works on the sample 
+// that lane k-1 finished on the previous step. So four sections cost about as much as one.
+
+#define BQ_CASCADE_MAX 16 // maximum number of sections
+#define BQ_CASCADE_GROUPS (BQ_CASCADE_MAX / 4)
+
+typedef struct bq_cascade
+{
+	// coefficients and state of group g (sections 4g to 4g+3), one section per lane. 
+	// The feedback coefficients are stored negated.
+	float32x4_t b0[BQ_CASCADE_GROUPS];
+	float32x4_t b1[BQ_CASCADE_GROUPS];
+	float32x4_t b2[BQ_CASCADE_GROUPS];
+	float32x4_t a1[BQ_CASCADE_GROUPS];
+	float32x4_t a2[BQ_CASCADE_GROUPS];
+	float32x4_t s1[BQ_CASCADE_GROUPS];
+	float32x4_t s2[BQ_CASCADE_GROUPS];
+	unsigned int nsections;
+	unsigned int ngroups;
+} bq_cascade_t;
+
+// set up a cascade of n sections (applied in order), copying their coefficients and state. 
+// returns 0 on OK, or -1 and sets errno (EINVAL) if n is 0 or more than BQ_CASCADE_MAX.
+int make_biquad_cascade(bq_cascade_t * output, const struct bq_filter * sections, int n);
+
+// apply the cascade to n samples. in and out may be the same buffer.
+void apply_biquad_cascade(bq_cascade_t * c, const float * in, float * out, int n);
+
+// move c's coefficients the fraction t (0 to 1) of the way to target's, keeping c's state. 
+// Both must have the same number of sections. Used to ramp smoothly to new coefficients.
+void bq_cascade_lerp(bq_cascade_t * c, const bq_cascade_t * target, float t);
+
+
+
+// A bank of four independent biquads that run in lockstep, one per SIMD lane (struct of arrays).
+// E.g. left and right channels, several bands of a multiband effect, or several chorus voices. 
+// Four filters cost about as much as one.
+
+typedef struct bq_bank
+{
+	// one filter per lane. The feedback coefficients are stored negated.
+	float32x4_t b0;
+	float32x4_t b1;
+	float32x4_t b2;
+	float32x4_t a1;
+	float32x4_t a2;
+	float32x4_t s1;
+	float32x4_t s2;
+} bq_bank_t;
+
+// set up a bank from up to 4 filters (copying their coefficients and state). Unused lanes output silence.
+// returns 0 on OK, or -1 and sets errno (EINVAL) if n isn't 1 to 4.
+int make_biquad_bank(bq_bank_t * output, const struct bq_filter * filters, int n);
+
+// filter k processes channel in[k] into out[k], for n samples. in[k] and out[k] may be the same buffer.
+// Lanes that aren't in use can be given NULL pointers.
+void apply_biquad_bank(bq_bank_t * b, const float * const in[4], float * const out[4], int n);
+
+// all four filters process the same input (e.g. to split it into bands). out[k] may be NULL.
+void apply_biquad_bank_split(bq_bank_t * b, const float * in, float * const out[4], int n);
 
 #endif
@@ -0,0 +1,218 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "calibrate.h"
+#include "convolution.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+
+// Linux/POSIX
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#define CAL_WARMUP 20 // untimed periods before each trial (caches, page faults)
+#define CAL_PERIODS 250 // timed periods per trial
+#define CAL_TRIALS 3 // we keep the best of the trials' worst cases, so that a single preemption doesn't skew the result
+#define CAL_KEYSZ 256
+#define CAL_LINESZ 512
+
+
+// worst-case time (ns) of one period of convolution_apply with an n sample IR. 
+// returns 0 on error.
+static uint64_t worst_case_ns(unsigned int period_sz, unsigned int n)
+{
+	float * IR = malloc(n * sizeof(float));
+	float * in = malloc(period_sz * sizeof(float));
+	float * out = malloc(period_sz * sizeof(float));
+	convolution_t conv;
+	char * msg = NULL;
+	uint64_t best = 0;
+	
+	if(!IR || !in || !out) goto done;
+	
+	// the values don't affect the timing, as long as they aren't denormal.
+	for(int k = 0; k < n; k++)
+		IR[k] = expf(-5.0f * k / n) / n;
+	for(int i = 0; i < period_sz; i++)
+		in[i] = (i % 7) * 0.01f;
+	
+	if(-1 == convolution_construct_ir(&conv, &msg, period_sz, IR, n)) goto done;
+	
+	best = UINT64_MAX;
+	for(int t = 0; t < CAL_TRIALS; t++)
+	{
+		uint64_t worst = 0;
+		for(int p = -CAL_WARMUP; p < CAL_PERIODS; p++)
+		{
+			uint64_t t0 = telemetry_now();
+			memcpy(convolution_getInputPtr(&conv), in, period_sz * sizeof(float));
+			convolution_apply(&conv, out);
+			uint64_t dt = telemetry_now() - t0;
+			if(p >= 0 && dt > worst) worst = dt;
+		}
+		if(worst < best) best = worst;
+	}
+	convolution_destruct(&conv);
+	
+done:
+	free(IR);
+	free(in);
+	free(out);
+	return best;
+}
+
+int calibrate_measure(unsigned int period_sz, unsigned int rate, float budget, unsigned int max_n)
+{
+	if(budget <= 0 || max_n < 4 || period_sz % 4 != 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	double budget_ns = budget * 1e9 * period_sz / rate;
+	
+	// binary search, in units of 4 samples. The cost is monotonic in the IR length.
+	// invariant: lo fits the budget (0 trivially does), hi doesn't.
+	unsigned int lo = 0, hi = max_n / 4 + 1;
+	while(hi - lo > 1)
+	{
+		unsigned int mid = (lo + hi) / 2;
+		uint64_t t = worst_case_ns(period_sz, mid * 4);
+		if(t == 0) return -1;
+		if(t <= budget_ns) lo = mid;
+		else hi = mid;
+	}
+	return lo * 4;
+}
+
+
+
+// identifies this machine: host name, architecture and CPU model.
+static void machine_key(char * key, size_t sz)
+{
+	struct utsname u;
+	if(-1 == uname(&u)) 
+	{
+		strcpy(u.nodename, "unknown");
+		strcpy(u.machine, "unknown");
+	}
+	
+	char model[128] = "unknown";
+	FILE * f = fopen("/proc/cpuinfo", "r");
+	if(f)
+	{
+		char line[CAL_LINESZ];
+		while(fgets(line, sizeof(line), f))
+		{
+			// "Model" on the raspberry pi, "model name" elsewhere
+			if(strncmp(line, "Model", 5) && strncmp(line, "model name", 10)) continue;
+			char * v = strchr(line, ':');
+			if(!v) continue;
+			v++;
+			while(isspace((unsigned char) *v)) v++;
+			snprintf(model, sizeof(model), "%s", v);
+			model[strcspn(model, "\n")] = 0;
+			if(!strncmp(line, "Model", 5)) break; // prefer the board model
+		}
+		fclose(f);
+	}
+	
+	snprintf(key, sz, "%s/%s/%s", u.nodename, u.machine, model);
+	for(char * c = key; *c; c++) 
+		if(isspace((unsigned char) *c)) *c = '_';
+}
+
+// path to the cache file. creates the directory if necessary.
+static int cache_path(char * path, size_t sz)
+{
+	const char * xdg = getenv("XDG_CACHE_HOME");
+	const char * home = getenv("HOME");
+	if(xdg && *xdg) snprintf(path, sz, "%s/guitardsp", xdg);
+	else if(home && *home) snprintf(path, sz, "%s/.cache/guitardsp", home);
+	else 
+	{
+		errno = ENOENT;
+		return -1;
+	}
+	
+	// mkdir -p (only the last two components can plausibly be missing)
+	char * slash = strrchr(path, '/');
+	*slash = 0;
+	mkdir(path, 0755);
+	*slash = '/';
+	if(-1 == mkdir(path, 0755) && errno != EEXIST) return -1;
+	
+	strncat(path, "/calibration", sz - strlen(path) - 1);
+	return 0;
+}
+
+// one line per configuration: "<machine> <period_sz> <rate> <budget> <max_n> <result>"
+static void config_key(char * key, size_t sz, unsigned int period_sz, unsigned int rate, float budget, unsigned int max_n)
+{
+	char machine[CAL_KEYSZ];
+	machine_key(machine, sizeof(machine));
+	snprintf(key, sz, "%s %u %u %.3f %u ", machine, period_sz, rate, budget, max_n);
+}
+
+bool calibrate_lookup(unsigned int period_sz, unsigned int rate, float budget, unsigned int max_n, unsigned int * n)
+{
+	char path[CAL_LINESZ], key[CAL_LINESZ], line[CAL_LINESZ];
+	if(-1 == cache_path(path, sizeof(path))) return false;
+	config_key(key, sizeof(key), period_sz, rate, budget, max_n);
+	
+	FILE * f = fopen(path, "r");
+	if(!f) return false;
+	
+	bool found = false;
+	while(fgets(line, sizeof(line), f))
+	{
+		if(strncmp(line, key, strlen(key))) continue;
+		found = (1 == sscanf(line + strlen(key), "%u", n));
+	}
+	fclose(f);
+	return found;
+}
+
+int calibrate_store(unsigned int period_sz, unsigned int rate, float budget, unsigned int max_n, unsigned int n)
+{
+	char path[CAL_LINESZ], tmp[CAL_LINESZ + 8], key[CAL_LINESZ], line[CAL_LINESZ];
+	if(-1 == cache_path(path, sizeof(path))) return -1;
+	config_key(key, sizeof(key), period_sz, rate, budget, max_n);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	
+	FILE * out = fopen(tmp, "w");
+	if(!out) return -1;
+	
+	// copy the other entries, replacing ours
+	FILE * in = fopen(path, "r");
+	if(in)
+	{
+		while(fgets(line, sizeof(line), in))
+			if(strncmp(line, key, strlen(key))) fputs(line, out);
+		fclose(in);
+	}
+	fprintf(out, "%s%u\n", key, n);
+	
+	if(fclose(out) != 0) return -1;
+	return rename(tmp, path);
+}
@@ -0,0 +1,43 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+// This file and the associated .c choose the impulse response length by measurement instead of guesswork.
+// 
+// The cost of the convolution grows linearly with the IR length, and it is by far the most expensive effect.
+// calibrate_measure benchmarks convolution_apply on the machine we're running on, at the configured period size,
+// and finds the longest IR whose worst-case processing time stays under a given fraction of the period.
+// The result is cached per machine (in $XDG_CACHE_HOME/guitardsp/calibration, or ~/.cache/...) 
+// so that the measurement only has to happen once.
+
+#include <stdbool.h>
+
+// returns the longest IR length (a multiple of 4, at most max_n) that keeps the worst-case time of 
+// convolution_apply under budget * (duration of one period). Returns 0 if not even 4 samples fit, 
+// or -1 (and sets errno) on error.
+int calibrate_measure(unsigned int period_sz, unsigned int rate, float budget, unsigned int max_n);
+
+// look up a previous result for this machine and configuration.
+// returns true and sets *n if found.
+bool calibrate_lookup(unsigned int period_sz, unsigned int rate, float budget, unsigned int max_n, unsigned int * n);
+
+// remember a result for this machine and configuration. returns 0 on success, -1 and sets errno on failure.
+int calibrate_store(unsigned int period_sz, unsigned int rate, float budget, unsigned int max_n, unsigned int n);
+
+#endif
@@ -16,6 +16,7 @@
 	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "chorusflange.h"
+#include "denormal.h"
 #include <stdlib.h>
 #include <math.h>
 #include <errno.h>
@@ -36,35 +37,49 @@ int timeMod_construct(timeMod_t * self, unsigned int samplerate,
 	}
 	
 	self->bq = NULL; // optional biquad filter (applied to the delayed signal only).
+	self->lofi = false;
+	self->excursion_mod = NULL;
 	
 	self->excursion = excursion; // amplitude of the pitch oscillation of the modulated signal
 	self->depth = depth; // perceived strength of the effect
 	self->lfo = lfo;
 	self->feedback = feedback;
+	self->interp = (interp_t) {INTERP_LINEAR, 0};
 	
 	// delay time
 	self->D = (delayTimeMS/1000.0) * samplerate;
 	
-	// delay buffer
-	self->w = calloc(self->D+1, sizeof(float));
-	// circular pointer into the allocated buffer
-	self->p = self->w;
-	
-	if(self->w)
-		return 0;
-	return -1;
+	// delay line (with room for timeMod_apply_block to write a whole chunk before reading it)
+	return ring_construct(&self->ring, self->D + TM_BLOCK_MAX + RING_GUARD);
 }
 
 
 void timeMod_destruct(timeMod_t * self)
 {
-	free(self->w);
+	ring_destruct(&self->ring);
 }
 
 
 
+int timeMod_set_interp(timeMod_t * self, int type)
+{
+	if(type != INTERP_LINEAR && type != INTERP_HERMITE && type != INTERP_LAGRANGE3)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	self->interp = (interp_t) {type, 0};
+	return 0;
+}
+
 // This implementation is based on examples from: Orfanidis, Introduction to Signal Processing (2010).
 
+// the modulated delay (in samples), for an LFO value
+static inline float timeMod_delay(const timeMod_t * self, float excursion, float lfo)
+{
+	float d = 0.5f * self->D * (1 - excursion * lfo);
+	return d < TM_MIN_DELAY ? TM_MIN_DELAY : d;
+}
 
 float timeMod_apply(timeMod_t * self, float sample)
 {
@@ -72,19 +87,101 @@ float timeMod_apply(timeMod_t * self, float sample)
 
 	// To implement modulation, we tap the delay line in a varying location.
 	// The varying amount of delay is what causes the pitch shifting that is characteristic of these effects.
-	// Hence the use of the 'tapi' (interpolated delay line tap) functions from delay.h/delay.c
 	
-	//float d = self->D - self->D * 0.5*self->excursion * (lfo_next(&self->lfo) + 1);
-	float d = 0.5 * self->D * (1 - self->excursion * lfo_next_tri(&self->lfo));
-	float s = tapi(self->D, self->w, self->p, d);
+	float d = timeMod_delay(self, self->excursion, lfo_next_tri(&self->lfo));
+	float s;
+	if(self->lofi)
+		s = ring_tap(&self->ring, (unsigned int) (d + 0.5f));
+	else
+	{
+		float u;
+		const float * p = ring_points(&self->ring, d, &u);
+		s = interp_read(&self->interp, p, u);
+	}
 	float y = (1.0-mix) * sample + mix * s;
-	//float y = 0.5 * (sample + s);
 	
 	float x = sample + s * self->feedback ;
 	
-	if(self->bq) *self->p = apply_biquad(self->bq,x); 
-	else *self->p = x;
-	
-	cdelay(self->D, self->w, &self->p);
+	if(self->bq) apply_biquad_generic(self->bq, &x, 1); // (unlike apply_biquad, guards the filter state against denormals)
+	ring_push(&self->ring, denormal_flush(x));
 	return y;
 }
+
+// read the modulated tap for the next n samples (delay[i] - i at least TM_MIN_DELAY)
+static void timeMod_read(timeMod_t * self, const float * delay, float * out, int n)
+{
+	if(self->lofi)
+	{
+		for(int i = 0; i < n; i++)
+			out[i] = ring_tap(&self->ring, (unsigned int) (delay[i] - i + 0.5f));
+	}
+	else
+		ring_read_frac(&self->ring, &self->interp, delay, out, n);
+}
+
+// filter the samples entering the delay line, and write them
+static void timeMod_write(timeMod_t * self, float * x, int n)
+{
+	if(self->bq) apply_biquad_generic(self->bq, x, n);
+	for(int i = 0; i < n; i++)
+		x[i] = denormal_flush(x[i]);
+	ring_write(&self->ring, x, n);
+}
+
+void timeMod_apply_block(timeMod_t * self, float * buf, int n)
+{
+	float traj[TM_BLOCK_MAX], s[TM_BLOCK_MAX], x[TM_BLOCK_MAX];
+	const float mix = 0.5f * self->depth, fb = self->feedback;
+	
+	for(int i = 0; i < n; )
+	{
+		int m = n - i < TM_BLOCK_MAX ? n - i : TM_BLOCK_MAX;
+		float * y = buf + i;
+		const float * exc = self->excursion_mod ? self->excursion_mod + i : NULL;
+		i += m;
+		
+		lfo_block_tri(&self->lfo, traj, m);
+		for(int j = 0; j < m; j++)
+			traj[j] = timeMod_delay(self, exc ? exc[j] : self->excursion, traj[j]);
+		
+		if(fb == 0)
+		{
+			// nothing is fed back, so the chunk can go into the line first, and be read as m samples older
+			memcpy(x, y, m * sizeof(float));
+			timeMod_write(self, x, m);
+			for(int j = 0; j < m; j++)
+				traj[j] += m;
+			timeMod_read(self, traj, s, m);
+		}
+		else
+		{
+			for(int j = 0; j < m; )
+			{
+				// the longest run whose taps are all in samples already written
+				int k = 1;
+				while(j + k < m && traj[j+k] - k >= TM_MIN_DELAY) k++;
+				timeMod_read(self, traj + j, s + j, k);
+				for(int l = j; l < j + k; l++)
+					x[l] = y[l] + fb * s[l];
+				timeMod_write(self, x + j, k);
+				j += k;
+			}
+		}
+		
+		for(int j = 0; j < m; j++)
+			y[j] = (1 - mix) * y[j] + mix * s[j];
+	}
+}
+
+void timeMod_bypass_block(timeMod_t * self, const float * buf, int n)
+{
+	float x[TM_BLOCK_MAX];
+	for(int i = 0; i < n; )
+	{
+		int m = n - i < TM_BLOCK_MAX ? n - i : TM_BLOCK_MAX;
+		memcpy(x, buf + i, m * sizeof(float));
+		timeMod_write(self, x, m);
+		i += m;
+	}
+	self->lfo.phase += n * self->lfo.inc;
+}
@@ -20,10 +20,13 @@
 
 // This file and the associated .c contain a generic implementation of a modulation effect (i.e. "chorus" or "flanger").
 
-#include "delay.h"
+#include "ring.h"
 #include "tremolo.h"
 #include "biquad_filt.h"
+#include <stdbool.h>
 
+#define TM_BLOCK_MAX 256 // timeMod_apply_block works in chunks of up to this many samples
+#define TM_MIN_DELAY 2 // the modulated delay never gets shorter than this (samples)
 
 // the struct contains the sate of the effect, and needn't be touched manually (with the exception of bq_filter, if the user wishes to insert a biquad filter into the delay line).
 // this structure is set up by the timeMod_construct function.
@@ -35,10 +38,12 @@ struct timeMod
 	float excursion;
 	float feedback;
 	lfo_t lfo;
-	float * w;
-	float * p;
+	ring_t ring; // delay line
 	int D;
+	interp_t interp; // how the modulated tap is interpolated (INTERP_LINEAR unless set with timeMod_set_interp)
 	struct bq_filter * bq; // manually set this (after calling _construct) to put a filter on the delay line.
+	bool lofi; // read the modulated tap without interpolation. Cheaper, but grainier. Set by the overload governor.
+	const float * excursion_mod; // modulation port (see modmatrix.h): per-sample excursion for timeMod_apply_block, or NULL to use excursion
 } timeMod_t;
 
 // For chorus: delay time is 5-30 ms
@@ -62,8 +67,23 @@ int timeMod_construct(timeMod_t * self, unsigned int samplerate,
 
 
 void timeMod_destruct(timeMod_t * self);
+
+// choose the interpolator for the modulated tap: INTERP_LINEAR, INTERP_HERMITE or INTERP_LAGRANGE3 (interp.h). 
+// Hermite or Lagrange keep the highs that linear interpolation dulls, and cut the noise of the moving tap.
+// returns 0, or -1 and sets errno (EINVAL) for anything else (the allpass can't follow a moving tap).
+int timeMod_set_interp(timeMod_t * self, int type);
 			
 // act on the next sample		
 float timeMod_apply(timeMod_t * self, float sample);
 
+// process n samples in place. Same as calling timeMod_apply on each, but the delay trajectory is computed for 
+// the whole chunk first, and the delay line is then read with vectorized interpolation and written with block copies.
+// Without feedback the whole chunk is written before it's read; with feedback, the chunk is split where the 
+// modulated tap would reach into samples that haven't been written yet.
+void timeMod_apply_block(timeMod_t * self, float * buf, int n);
+
+// while the effect is bypassed: keep the delay line written (and the LFO turning), without the cost of reading it, 
+// so that it has no stale audio in it when it's switched back on. buf is left alone.
+void timeMod_bypass_block(timeMod_t * self, const float * buf, int n);
+
 #endif
@@ -83,28 +83,50 @@ int convolution_construct(convolution_t * self, char ** errMsg, unsigned int * r
 	}
 	int n_to_read = wav.totalSampleCount > IR_max_size_truncate ? IR_max_size_truncate : wav.totalSampleCount;
 	
-	self->periodsz = period_sz;
-	self->n = n_to_read;
-	self->data = malloc(sizeof(float32x4_t) * self->n + sizeof(float) * (self->n + self->periodsz - 1));
-	if(!self->data)
-	{
-		snprintf(errmsg, CONV_ERRMSG_BUFSZ-1, "%s", strerror(errno));
-		*errMsg = errmsg;
-		drwav_uninit(&wav);
-		return -1;
-	}
-	memset(self->data, 0, sizeof(float32x4_t) * self->n + sizeof(float) * (self->n + self->periodsz - 1));
 	float IR[n_to_read];
 	size_t sampsread = drwav_read_f32(&wav, n_to_read, IR);
+	drwav_uninit(&wav);
 	
 	if(sampsread != n_to_read)
 	{
 		snprintf(errmsg, CONV_ERRMSG_BUFSZ-1, "Expected %u samples, but got %zu", n_to_read, sampsread);
 		*errMsg = errmsg;
-		drwav_uninit(&wav);
 		return -1;
 	}
 	
+	// keep the truncation warning (if any) unless setting up the buffers fails
+	char * warning = *errMsg;
+	if(-1 == convolution_construct_ir(self, errMsg, period_sz, IR, n_to_read)) return -1;
+	*errMsg = warning;
+	return 0;
+}
+
+
+int convolution_construct_ir(convolution_t * self, char ** errMsg, unsigned int period_sz, const float * IR, unsigned int n)
+{
+	if(period_sz % 4 != 0)
+	{
+		snprintf(errmsg, CONV_ERRMSG_BUFSZ-1, "period_sz must be divisible by 4");
+		*errMsg = errmsg;
+		return -1;
+	}
+	
+	memset(self, 0 , sizeof(convolution_t));
+	
+	self->periodsz = period_sz;
+	self->n = n;
+	self->n_active = n;
+	self->n_prev = n;
+	self->fade = CONV_FADE_PERIODS;
+	self->data = malloc(sizeof(float32x4_t) * self->n + sizeof(float) * (self->n + self->periodsz - 1));
+	if(!self->data)
+	{
+		snprintf(errmsg, CONV_ERRMSG_BUFSZ-1, "%s", strerror(errno));
+		*errMsg = errmsg;
+		return -1;
+	}
+	memset(self->data, 0, sizeof(float32x4_t) * self->n + sizeof(float) * (self->n + self->periodsz - 1));
+	
 	float32x4_t* kernel_reverse = (float32x4_t*)self->data;
  
 	// Reverse the kernel and repeat each value across a 4-vector
@@ -118,8 +140,6 @@ int convolution_construct(convolution_t * self, char ** errMsg, unsigned int * r
 		kernel_reverse[i] = vld1q_f32(kernel_block);
 	}
 	
-	drwav_uninit(&wav);
-	
 	return 0;
 }
 
@@ -130,6 +150,17 @@ void convolution_destruct(convolution_t * self)
 }
 
 
+void convolution_setActiveLength(convolution_t * self, unsigned int n_active)
+{
+	if(n_active < 1) n_active = 1;
+	if(n_active > self->n) n_active = self->n;
+	if(n_active == self->n_active) return;
+	self->n_prev = self->n_active;
+	self->n_active = n_active;
+	self->fade = 0;
+}
+
+
 // return pointer to the data buffer.
 float * convolution_getInputPtr(convolution_t * self)
 {
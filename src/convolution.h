@@ -18,12 +18,16 @@
 #ifndef CONVOLUTION_H
 #define CONVOLUTION_H
 
+#define CONV_FADE_PERIODS 4 // a change of the active length fades the taps in between in or out over this many calls to convolution_apply
 
 typedef struct convolution
 {
 	char * data;
 	unsigned int periodsz;
 	unsigned int n;
+	unsigned int n_active; // number of IR samples actually used (n, unless the tail has been cut short to save time)
+	unsigned int n_prev; // n_active before the last change, while it's being faded from
+	unsigned int fade; // calls to convolution_apply since the last change (CONV_FADE_PERIODS once the fade is done)
 } convolution_t;
 
 // returns 0 on success, -1 on error. 
@@ -31,11 +35,20 @@ typedef struct convolution
 // errMsg might be set even on success (a warning). You can print this or ignore it.
 int convolution_construct(convolution_t * self, char ** errMsg, unsigned int * rate, unsigned int period_sz, const char * IR_filename, unsigned int IR_max_size_truncate);
 
+// same as above, but takes the impulse response (n samples) from memory instead of a wav file.
+int convolution_construct_ir(convolution_t * self, char ** errMsg, unsigned int period_sz, const float * IR, unsigned int n);
+
 void convolution_destruct(convolution_t * self);
 
 // returns a pointer to the input buffer for this convolution object. Write samples to that buffer before calling convolution_apply
 float * convolution_getInputPtr(convolution_t * self);
 
+// use only the first n_active samples of the IR (clamped to 1..n). The cost of convolution_apply is proportional to this.
+// Can be changed between calls to convolution_apply. Cutting the tail (or restoring it) in one go would make the 
+// output jump by its contribution, so the taps in between fade out (or in) over CONV_FADE_PERIODS calls; until 
+// then the cost is that of the longer length. A change during a fade starts a new one from the current length.
+void convolution_setActiveLength(convolution_t * self, unsigned int n_active);
+
 
 #include <string.h>
 #include <arm_neon.h>
@@ -48,15 +61,47 @@ static inline void convolution_apply(convolution_t * self, float * output)
 	float * buffer = (float*) (self->data + sizeof(float32x4_t) * self->n);
 	float32x4_t* kernel_reverse = (float32x4_t*)self->data;
 	
-	float32x4_t out, data_block;
+	// While the active length is changing, the taps between the old and new lengths (the kernel is reversed, 
+	// so they're the first ones) are summed separately and faded, by a gain going from g0 to g1 across the period.
+	unsigned int lo = self->n_active, hi = self->n_active;
+	float g0 = 1, g1 = 1;
+	if(self->fade < CONV_FADE_PERIODS)
+	{
+		lo = self->n_prev < self->n_active ? self->n_prev : self->n_active;
+		hi = self->n_prev < self->n_active ? self->n_active : self->n_prev;
+		g0 = (float) self->fade / CONV_FADE_PERIODS;
+		g1 = (float) (self->fade + 1) / CONV_FADE_PERIODS;
+		if(self->n_active < self->n_prev) // fading out
+		{
+			g0 = 1 - g0;
+			g1 = 1 - g1;
+		}
+		self->fade++;
+	}
+	const float gstep = (g1 - g0) / self->periodsz;
+	const float ramp[4] = {1, 2, 3, 4};
+	
+	float32x4_t out, tail, data_block;
 	for(int i=0; i<self->periodsz; i+=4){
 		out = vmovq_n_f32(0.0f);
 		// After this loop, we have computed 4 output samples for the price of one.
-		for(int k=0; k<self->n; k++)
+		// the kernel is reversed, so skipping the first taps skips the end of the IR.
+		for(int k=self->n - lo; k<self->n; k++)
 		{
 			data_block = vld1q_f32(&buffer[i+k]);
 			out = vfmaq_f32(out,data_block,kernel_reverse[k]);
 		}
+		if(hi != lo)
+		{
+			tail = vmovq_n_f32(0.0f);
+			for(int k=self->n - hi; k<self->n - lo; k++)
+			{
+				data_block = vld1q_f32(&buffer[i+k]);
+				tail = vfmaq_f32(tail,data_block,kernel_reverse[k]);
+			}
+			float32x4_t g = vmlaq_n_f32(vmovq_n_f32(g0 + gstep * i), vld1q_f32(ramp), gstep);
+			out = vfmaq_f32(out,tail,g);
+		}
 		vst1q_f32(output+i, out);
 
 	}
@@ -16,20 +16,224 @@
 	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "delay.h"
+#include "denormal.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <math.h>
+
+// The longest chunk that can be processed in one go: it can't be longer than the delay, or its end would echo 
+// its own beginning. While the read head glides it can move closer by up to DELAY_GLIDE_MAX per sample, 
+// and the interpolator looks a couple of samples ahead.
+static inline int delay_chunk(const struct simple_delay * delay)
+{
+	int chunk;
+	if(!delay->moving)
+		chunk = delay->D;
+	else if(delay->move == DELAY_JUMP && delay->d == delay->D)
+		chunk = delay->D < delay->target ? delay->D : delay->target;
+	else
+	{
+		float d = delay->d < delay->target ? delay->d : delay->target;
+		chunk = (d - 3) / (1 + DELAY_GLIDE_MAX);
+	}
+	return chunk < 1 ? 1 : chunk > DELAY_BLOCK_MAX ? DELAY_BLOCK_MAX : chunk;
+}
+
+// start moving the read head from (which needn't be a whole number of samples) to target
+static void start_move(struct simple_delay * delay, float from, unsigned int target, int move)
+{
+	if(from < DELAY_MIN) from = DELAY_MIN; // (the interpolator needs a few samples of room)
+	delay->D = from;
+	delay->d = from;
+	delay->target = target;
+	delay->move = move;
+	delay->fade = 0;
+	delay->moving = true;
+}
+
+// the move has landed on target
+static void end_move(struct simple_delay * delay)
+{
+	delay->D = delay->target;
+	delay->d = delay->target;
+	delay->moving = false;
+	if(delay->pending)
+	{
+		if(delay->pending != delay->D)
+			start_move(delay, delay->D, delay->pending, delay->pending_move);
+		delay->pending = 0;
+	}
+}
+
+// read the next m samples from the delay line (m no more than delay_chunk), and move the read head along
+static void delay_echo(struct simple_delay * delay, float * echo, int m)
+{
+	if(!delay->moving)
+	{
+		ring_read(&delay->ring, delay->D, echo, m);
+		delay->interp.y1 = echo[m-1]; // (so that a thiran interpolator starts from where we are)
+	}
+	else if(delay->move == DELAY_JUMP)
+	{
+		float next[DELAY_BLOCK_MAX];
+		if(delay->d == delay->D)
+			ring_read(&delay->ring, delay->D, echo, m);
+		else
+		{
+			// a jump that interrupted a glide fades out from wherever the read head had got to
+			float traj[DELAY_BLOCK_MAX];
+			for(int j = 0; j < m; j++)
+				traj[j] = delay->d;
+			ring_read_frac(&delay->ring, &delay->interp, traj, echo, m);
+		}
+		ring_read(&delay->ring, delay->target, next, m);
+		for(int j = 0; j < m; j++)
+		{
+			float g = (float) (delay->fade + j) / DELAY_XFADE;
+			if(g > 1) g = 1;
+			echo[j] += g * (next[j] - echo[j]);
+		}
+		delay->fade += m;
+		if(delay->fade >= DELAY_XFADE)
+			end_move(delay);
+	}
+	else
+	{
+		// The read head approaches the target exponentially, but no faster than DELAY_GLIDE_MAX. 
+		// It finishes with steps of at least DELAY_GLIDE_MIN, since smaller ones would be lost to float rounding.
+		float traj[DELAY_BLOCK_MAX];
+		float d = delay->d, target = delay->target;
+		for(int j = 0; j < m; j++)
+		{
+			float step = (target - d) * delay->glide_coef;
+			step = step > DELAY_GLIDE_MAX ? DELAY_GLIDE_MAX : step < -DELAY_GLIDE_MAX ? -DELAY_GLIDE_MAX : step;
+			if(fabsf(step) < DELAY_GLIDE_MIN) step = d < target ? DELAY_GLIDE_MIN : -DELAY_GLIDE_MIN;
+			d = fabsf(target - d) <= DELAY_GLIDE_MIN ? target : d + step;
+			traj[j] = d;
+		}
+		ring_read_frac(&delay->ring, &delay->interp, traj, echo, m);
+		delay->d = d;
+		if(d == target) 
+			end_move(delay);
+	}
+}
+
+int simple_delay_set_time(struct simple_delay * delay, float ms, int move)
+{
+	float d = ms * delay->samplerate / 1000;
+	if(ms < 0 || ms > DELAY_MAX_MS || (move != DELAY_GLIDE && move != DELAY_JUMP))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	unsigned int target = d < DELAY_MIN ? DELAY_MIN : d + 0.5f;
+	
+	if(delay->moving)
+	{
+		if(delay->move == DELAY_JUMP)
+		{
+			// cutting a crossfade short would click, so the new move starts after it
+			delay->pending = target;
+			delay->pending_move = move;
+			return 0;
+		}
+		if(move == DELAY_GLIDE)
+		{
+			delay->target = target; // just carry on gliding from where the read head is
+			return 0;
+		}
+		start_move(delay, delay->d, target, move); // jump from where the read head has got to
+		return 0;
+	}
+	if(target != delay->D)
+		start_move(delay, delay->D, target, move);
+	return 0;
+}
+
+void simple_delay_set_interp(struct simple_delay * delay, int type)
+{
+	delay->interp.type = type;
+}
 
 float simple_delay_apply(struct simple_delay * delay, float sample)
 {
-	float output = sample + delay->mix * delay->dLine[delay->pos];
-	delay->dLine[delay->pos] = sample + delay->feedback_gain * delay->dLine[delay->pos];
+	float old;
+	delay_echo(delay, &old, 1);
+	float output = sample + delay->mix * old;
+	float fb = sample + delay->feedback_gain * old;
 	if(delay->feedback_fn) 
-		delay->dLine[delay->pos] = delay->feedback_fn(delay->feedback_fn_arg, delay->dLine[delay->pos]);
-	delay->pos = (delay->pos + 1) % delay->dLine_n;
+		delay->feedback_fn(delay->feedback_fn_arg, &fb, 1);
+	ring_push(&delay->ring, denormal_flush(fb)); // the echoes decay through the denormals otherwise
 	return output;
 }
 
+void delay_fb_biquad_sat(void * filt, float * buf, int n)
+{
+	apply_biquad_block((struct bq_filter *) filt, buf, buf, n);
+	for(int i = 0; i < n; i++)
+		buf[i] = delay_saturate(buf[i]);
+}
+
+// The body of simple_delay_apply_block. fb_type is a constant in each of the variants below, 
+// so the compiler drops the branches that don't apply and inlines the filter into the loop.
+static inline __attribute__((always_inline)) 
+void delay_block(struct simple_delay * delay, float * buf, int n, const int fb_type)
+{
+	float echo[DELAY_BLOCK_MAX];
+	float fb[DELAY_BLOCK_MAX];
+	const float mix = delay->mix, g = delay->feedback_gain;
+	struct bq_filter f;
+	if(fb_type == DELAY_FB_BIQUAD || fb_type == DELAY_FB_BIQUAD_SAT)
+		f = *(struct bq_filter *) delay->feedback_fn_arg;
+	
+	for(int i = 0; i < n; )
+	{
+		int chunk = delay_chunk(delay);
+		int m = n - i < chunk ? n - i : chunk;
+		float * x = buf + i;
+		const float * mix_mod = delay->mix_mod ? delay->mix_mod + i : NULL;
+		i += m;
+		
+		delay_echo(delay, echo, m);
+		for(int j = 0; j < m; j++)
+		{
+			float v = x[j] + g * echo[j];
+			x[j] += (mix_mod ? mix_mod[j] : mix) * echo[j];
+			if(fb_type == DELAY_FB_BIQUAD || fb_type == DELAY_FB_BIQUAD_SAT)
+				v = biquad_tick(&f, v);
+			if(fb_type == DELAY_FB_BIQUAD_SAT)
+				v = delay_saturate(v);
+			fb[j] = v;
+		}
+		if(fb_type == DELAY_FB_CUSTOM) 
+			delay->feedback_fn(delay->feedback_fn_arg, fb, m);
+		for(int j = 0; j < m; j++)
+			fb[j] = denormal_flush(fb[j]);
+		ring_write(&delay->ring, fb, m);
+	}
+	
+	if(fb_type == DELAY_FB_BIQUAD || fb_type == DELAY_FB_BIQUAD_SAT)
+	{
+		struct bq_filter * filt = delay->feedback_fn_arg;
+		filt->dly1 = denormal_flush(f.dly1);
+		filt->dly2 = denormal_flush(f.dly2);
+	}
+}
+
+#define DELAY_VARIANT(name, fb_type) \
+	static void name(struct simple_delay * delay, float * buf, int n) { delay_block(delay, buf, n, fb_type); }
+
+DELAY_VARIANT(delay_block_custom, DELAY_FB_CUSTOM)
+DELAY_VARIANT(delay_block_none, DELAY_FB_NONE)
+DELAY_VARIANT(delay_block_biquad, DELAY_FB_BIQUAD)
+DELAY_VARIANT(delay_block_biquad_sat, DELAY_FB_BIQUAD_SAT)
+
+void simple_delay_apply_block(struct simple_delay * delay, float * buf, int n)
+{
+	delay->apply_block(delay, buf, n);
+}
+
 int simple_delay_construct(struct simple_delay * output, 
 						    float feedback, 
 						    float mix, 
@@ -47,24 +251,54 @@ int simple_delay_construct(struct simple_delay * output,
 			return -1;
 		}
 	
-	output->dLine_n = (size_t)(delayTimeMS * sampRate / 1000);
-	output->dLine = malloc(sizeof(float) * output->dLine_n);
-	if(!output->dLine) return -1;
-	memset(output->dLine, 0, sizeof(float) * output->dLine_n);
+	output->D = (unsigned int)(delayTimeMS * sampRate / 1000);
+	if(output->D < 1) output->D = 1;
+	output->target = output->D;
+	output->d = output->D;
+	output->move = DELAY_GLIDE;
+	output->fade = 0;
+	output->moving = false;
+	output->pending = 0;
+	output->glide_coef = 1000.0 / (DELAY_GLIDE_MS * sampRate);
+	output->interp = (interp_t) {INTERP_LAGRANGE3, 0};
+	output->samplerate = sampRate;
+	if(-1 == ring_construct(&output->ring, DELAY_MAX_MS * sampRate / 1000 + RING_GUARD)) 
+		return -1;
 	
-	output->pos = 0;
 	output->mix = mix;
+	output->mix_mod = NULL;
 	output->feedback_gain = feedback;
 	
 	output->feedback_fn = feedback_fn;
 	output->feedback_fn_arg = feedback_fn_arg;
 	
+	if(!feedback_fn)
+	{
+		output->fb_type = DELAY_FB_NONE;
+		output->apply_block = delay_block_none;
+	}
+	else if(feedback_fn == apply_biquad_generic)
+	{
+		output->fb_type = DELAY_FB_BIQUAD;
+		output->apply_block = delay_block_biquad;
+	}
+	else if(feedback_fn == delay_fb_biquad_sat)
+	{
+		output->fb_type = DELAY_FB_BIQUAD_SAT;
+		output->apply_block = delay_block_biquad_sat;
+	}
+	else
+	{
+		output->fb_type = DELAY_FB_CUSTOM;
+		output->apply_block = delay_block_custom;
+	}
+	
 	return 0;
 }
 
 void simple_delay_destruct(struct simple_delay * delay)
 {
-	free(delay->dLine);
+	ring_destruct(&delay->ring);
 }
 
 
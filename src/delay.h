@@ -20,7 +20,43 @@
 
 // this file and the associated .c contain an implementation of a simple delay (echo) effect.
 
-typedef float (*fdbk_fn_t) (void*,float);
+#include "ring.h"
+#include "biquad_filt.h"
+#include <stdbool.h>
+
+// processes (e.g. filters) n samples in place
+typedef void (*fdbk_fn_t) (void*, float*, int);
+
+// Feedback callback: a biquad (feedback_fn_arg is a struct bq_filter) followed by soft saturation, 
+// so that high feedback settings compress instead of running away. 
+void delay_fb_biquad_sat(void * filt, float * buf, int n);
+
+// The common feedback paths have their own specialized versions of simple_delay_apply_block, with the filter 
+// inlined into the loop. simple_delay_construct picks one by looking at feedback_fn: 
+// NULL, apply_biquad_generic or delay_fb_biquad_sat. Anything else is called through the pointer.
+#define DELAY_FB_CUSTOM 0
+#define DELAY_FB_NONE 1
+#define DELAY_FB_BIQUAD 2
+#define DELAY_FB_BIQUAD_SAT 3
+
+// soft clipper (a rational approximation of tanh), saturating at +/-1
+static inline float delay_saturate(float x)
+{
+	x = x > 3.0f ? 3.0f : x < -3.0f ? -3.0f : x;
+	return x * (27.0f + x * x) / (27.0f + 9.0f * x * x);
+}
+
+#define DELAY_BLOCK_MAX 256 // simple_delay_apply_block works in chunks of up to this many samples
+#define DELAY_MAX_MS 1000.0 // the delay line is always this long, so that the time can be changed while running
+
+// ways of moving to a new delay time (simple_delay_set_time)
+#define DELAY_GLIDE 0 // the read head slides to the new time, bending the pitch of the echoes like a tape delay
+#define DELAY_JUMP 1 // crossfade from the old time to the new one
+#define DELAY_XFADE 1024 // length of the DELAY_JUMP crossfade, in samples
+#define DELAY_GLIDE_MS 150.0 // time constant of DELAY_GLIDE
+#define DELAY_GLIDE_MAX 0.5 // fastest the read head moves in DELAY_GLIDE (samples per sample, i.e. +/- 50% pitch)
+#define DELAY_GLIDE_MIN 0.01 // slowest it moves (until it arrives)
+#define DELAY_MIN 8 // shortest time (samples) simple_delay_set_time allows
 
 typedef
 struct simple_delay
@@ -31,14 +67,39 @@ struct simple_delay
 	float feedback_gain; // gain each time the delay line feeds back. 0 = no feedback, 1 = signal never decays.
 	
 	float mix; // mix percentage betwen effected (delayed) signal and dry signal.
+	const float * mix_mod; // modulation port (see modmatrix.h): per-sample mix for simple_delay_apply_block, or NULL to use mix
+	
+	ring_t ring; // delay line
+	unsigned int D; // delay in samples (when the read head isn't moving)
+	unsigned int target; // delay the read head is moving to (or D)
+	float d; // fractional position of the read head while it's gliding (or where a DELAY_JUMP crossfades from)
+	bool moving; // a move is in progress (target can equal D mid-glide, e.g. when sent back to where it started)
+	int move; // DELAY_GLIDE or DELAY_JUMP
+	int fade; // samples into a DELAY_JUMP crossfade
+	unsigned int pending; // move requested during a crossfade, to be started when it finishes (0 = none)
+	int pending_move;
+	float glide_coef;
+	interp_t interp; // how the gliding read head is interpolated (INTERP_LAGRANGE3 by default)
+	unsigned int samplerate;
 	
-	float * dLine; // delay line buffer
-	unsigned int dLine_n; // delay line size
-	int pos; // current position in delay line
+	int fb_type; // DELAY_FB_ constant
+	void (*apply_block)(struct simple_delay *, float *, int); // the variant for fb_type
 }simple_delay_t;
 
 float simple_delay_apply(struct simple_delay * delay, float sample);
 
+// process n samples in place. Same result as calling simple_delay_apply on each, but the delay line is read and 
+// written a block at a time (a straight copy of at most two segments), and the feedback callback is called per block.
+void simple_delay_apply_block(struct simple_delay * delay, float * buf, int n);
+
+// change the delay time while running, without clicks: move is DELAY_GLIDE or DELAY_JUMP. 
+// Call it between periods (from the audio thread). Doesn't allocate.
+// returns 0 if ok, -1 and sets errno (EINVAL) if ms is beyond DELAY_MAX_MS.
+int simple_delay_set_time(struct simple_delay * delay, float ms, int move);
+
+// choose the interpolator used while gliding (INTERP_ constant from interp.h)
+void simple_delay_set_interp(struct simple_delay * delay, int type);
+
 // feedback and mix should be 0 to 1
 // returns 0 if ok, -1 and sets errno on an error.
 int simple_delay_construct(struct simple_delay * output, 
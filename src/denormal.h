@@ -0,0 +1,90 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef DENORMAL_H
+#define DENORMAL_H
+
+// Denormal (subnormal) protection. 
+// Recursive paths (filters, feedback delays) decay exponentially towards zero once the input goes quiet, and on 
+// the way they pass through the subnormal floating point range, which is many times slower on most FPUs 
+// (including ARM VFP) - just when the player stops, the DSP time can spike enough to cause xruns.
+// Two defences: denormal_ftz_set makes the FPU flush subnormals to zero (for the calling thread only), and 
+// denormal_flush / denormal_flushq are explicit guards for the recursive paths, for when that's not available.
+// (ARMv7 NEON instructions always flush subnormals; the VFP, which does the scalar float math, doesn't unless told to.)
+
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// anything quieter than this (-300 dB) is treated as silence by the guards
+#define DENORMAL_THRESHOLD 1e-15f
+
+// enable (or disable) flush-to-zero for the calling thread. On x86 this also sets denormals-are-zero.
+// returns 0, or -1 and sets errno (ENOTSUP) on an architecture we don't know how to do it on.
+static inline int denormal_ftz_set(bool enable)
+{
+#if defined(__aarch64__)
+	unsigned long fpcr;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	fpcr = enable ? fpcr | (1UL << 24) : fpcr & ~(1UL << 24); // FZ
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+	return 0;
+#elif defined(__arm__)
+	unsigned int fpscr;
+	__asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+	fpscr = enable ? fpscr | (1U << 24) : fpscr & ~(1U << 24); // FZ
+	__asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+	return 0;
+#elif defined(__x86_64__) || defined(__i386__)
+	unsigned int csr = _mm_getcsr();
+	csr = enable ? csr | 0x8040 : csr & ~0x8040u; // FTZ | DAZ
+	_mm_setcsr(csr);
+	return 0;
+#else
+	(void) enable;
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+static inline float denormal_flush(float x)
+{
+	return fabsf(x) < DENORMAL_THRESHOLD ? 0.0f : x;
+}
+
+// the vector guards only exist where there's NEON (the rest of this header builds anywhere)
+#if defined(__ARM_NEON)
+static inline float32x4_t denormal_flushq(float32x4_t x)
+{
+	uint32x4_t keep = vcageq_f32(x, vdupq_n_f32(DENORMAL_THRESHOLD));
+	return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(x), keep));
+}
+
+static inline float32x2_t denormal_flush2(float32x2_t x)
+{
+	uint32x2_t keep = vcage_f32(x, vdup_n_f32(DENORMAL_THRESHOLD));
+	return vreinterpret_f32_u32(vand_u32(vreinterpret_u32_f32(x), keep));
+}
+#endif
+
+#endif
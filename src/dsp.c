@@ -25,6 +25,7 @@
 #include <time.h>
 #include <stdbool.h>
 #include <stdatomic.h>
+#include <signal.h>
 
 #include <alsa/asoundlib.h>
 
@@ -32,17 +33,59 @@
 #include <unistd.h> 
 #include <sys/resource.h>
 #include <sched.h>
+#include <pthread.h>
 
 #include "biquad_filt.h"
 #include "delay.h"
 #include "convolution.h"
 #include "tremolo.h"
 #include "chorusflange.h"
+#include "eq.h"
+#include "wah.h"
+#include "multitap.h"
+#include "stereodelay.h"
+#include "ensemble.h"
+#include "modmatrix.h"
+#include "looper.h"
+#include "resample.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "calibrate.h"
+#include "governor.h"
+#include "denormal.h"
 
 
 #define PERIODSZ 64 // Number of samples to fetch/write at a time from the audio device, i.e. wakeup interval
 #define NPERIODS 2 // Number of periods that ALSA buffers at a time. Total latency is period size * number of periods buffered (each direction).
 #define N 1440 // Impulse response length. Longer impulse responses are truncated. Strongly affects whether or not this program will be able to hit it's audio IO deadlines.
+#define N_MAX 8192 // Upper limit on the impulse response length when it is chosen by measurement instead (--calibrate).
+#define DEFAULT_BUDGET 0.5 // Fraction of each period that --calibrate lets the convolution use. The rest is left for the other effects.
+#define LOOPER_MAX_SECONDS 600 // Longest loop (--looper). Costs disk space for the scratch file, not memory.
+#define TRACE_KEEP_SECONDS 5 // --trace keeps this much of the timeline in memory, and writes it out after each xrun (see trace.h)
+#define MOD_CTRL 16 // control period of the modulation matrix (samples)
+#define MOD_INTERP INTERP_HERMITE // how the chorus/flange and ensemble interpolate their modulated taps (see interp.h)
+
+// The overload governor (see governor.h) degrades the processing in these steps, in order, when it is running out of time.
+// Optional effects are the tremolo, chorus/flange and ensemble: the tone still works without them. They're faded
+// out and back in over SHED_FADE_PERIODS, so bypassing them doesn't click.
+static const struct
+{
+	float ir_fraction; // fraction of the IR that is convolved (the tail is cut off, and restored, with a short fade)
+	bool linear_mod; // linear interpolation (instead of MOD_INTERP) in the chorus/flange and ensemble
+	bool lofi_mod; // no interpolation at all in the chorus/flange
+	bool bypass_optional; // bypass the optional effects
+} shed_levels[] = 
+{
+	{1.00, false, false, false}, // full quality
+	{0.75, true, false, false},
+	{0.50, true, true, false},
+	{0.50, true, true, true},
+	{0.25, true, true, true},
+};
+#define GOV_HIGH 0.85 // start degrading when the DSP takes more than this fraction of a period
+#define GOV_LOW 0.6 // restore when it takes less than this fraction...
+#define GOV_HOLD 1000 // ...for this many periods in a row
+#define SHED_FADE_PERIODS 2 // the optional effects fade out (and back in) over this many periods when they're bypassed
 
 _Static_assert(N % 4 == 0, "N must be divisible by 4");
 _Static_assert(PERIODSZ % 4 == 0, "PERIODSZ must be divisible by 4");
@@ -204,6 +247,67 @@ inline float amp_to_db(float amp)
 }
 
 
+// Set by SIGINT and SIGTERM, so that the main loop exits through the cleanup at the end of main 
+// (which finishes the trace, removes the looper's scratch file and the shared memory statistics).
+static volatile sig_atomic_t quit = 0;
+
+static void on_quit_signal(int sig)
+{
+	(void) sig;
+	quit = 1;
+}
+
+
+// Fade an optional effect's output (buf, in place) against its input (dry),
+// with the wet gain going from g0 to g1 across the period. Used when the governor bypasses or restores it.
+static void shed_fade(float * buf, const float * dry, float g0, float g1)
+{
+	for(int i = 0; i < PERIODSZ; i++)
+	{
+		float g = g0 + (g1 - g0) * (i + 1) / PERIODSZ;
+		buf[i] = dry[i] + g * (buf[i] - dry[i]);
+	}
+}
+
+
+// Periodically prints the realtime loop's timing statistics (--stats).
+// Runs in its own thread and only ever takes snapshots, so it can't hold up the audio thread.
+void * stats_thread(void * arg)
+{
+	telemetry_t * tm = arg;
+	struct telemetry_stats snap;
+	while(1)
+	{
+		sleep(2);
+		telemetry_snapshot(tm, &snap);
+		telemetry_print(&snap, stdout);
+		fflush(stdout);
+	}
+	return NULL;
+}
+
+// Reads looper commands from the terminal (--looper), one letter per line.
+void * looper_control_thread(void * arg)
+{
+	looper_t * lp = arg;
+	int c;
+	while((c = getchar()) != EOF)
+	{
+		switch(c)
+		{
+			case 'r': looper_command(lp, LOOPER_RECORD); break;
+			case 'o': looper_command(lp, LOOPER_OVERDUB); break;
+			case 'm': looper_command(lp, LOOPER_MULTIPLY); break;
+			case 'p': looper_command(lp, LOOPER_PLAY); break;
+			case 's': looper_command(lp, LOOPER_STOP); break;
+			case 'u': looper_command(lp, LOOPER_UNDO); break;
+			case 'c': looper_command(lp, LOOPER_CLEAR); break;
+		}
+	}
+	return NULL;
+}
+
+
 int  
 main (int argc, char *argv[])
 {
@@ -211,15 +315,42 @@ main (int argc, char *argv[])
 	// These variables enable and disable the various effects that have been implemented.
 	// At the moment they cannot currently be configured while the program is running. 
 	bool efx_conv = true; // convolution
+	bool efx_eq = false; // parametric EQ (tone shaping after the cab IR)
 	bool efx_lowcut = false; // highpass filter
+	bool efx_wah = false;
 	bool efx_tremolo = false;
+	int tremolo_mode = TREM_CLASSIC; // or TREM_HARMONIC, or TREM_AUTOPAN (which moves the tremolo to the stereo section)
 	bool efx_choflange = false;
 	bool efx_delay = false;
+	bool efx_multitap = false; // stereo, rhythmic delay
+	bool efx_stereodelay = false; // ping-pong
+	bool efx_ensemble = false; // stereo, multi-voice chorus
+	bool efx_looper = false; // (--looper)
+	bool modulation = false; // drive some of the parameters above from the modulation matrix (see below)
+	
+	// When the input and output are separate sound cards, their clocks drift apart. 
+	// Drift compensation resamples the output to follow the playback device's clock.
+	bool drift_comp = strcmp(IDEVICE, ODEVICE) != 0;
 	
 	// We're expecting to get the impulse response filename (wav) as a command line argument.
 	// We also can accept a second command line argument that indicates the gain in DB (prefixed by + or -).
+	// Options are prefixed by --
+	//	--stats		print timing statistics of the realtime loop every couple of seconds
+	//	--trace=FILE	record a timeline of the realtime loop to FILE (chrome trace format)
+	//	--calibrate	choose the IR length by measuring what this machine can afford (the result is cached per machine)
+	//	--recalibrate	same, but ignore any cached result
+	//	--budget=F	fraction of each period that the convolution may use, for --calibrate (default 0.5)
+	//	--no-governor	never degrade the processing to avoid overruns (see shed_levels)
+	//	--looper=FILE	enable the looper, using FILE as scratch space for the loop. It is controlled from the terminal.
 	int av_ir_idx = 0;
 	float gain = 1.0;
+	bool show_stats = false;
+	const char * trace_file = NULL;
+	bool calibrate = false;
+	bool recalibrate = false;
+	float budget = DEFAULT_BUDGET;
+	bool use_governor = true;
+	const char * looper_file = NULL;
 	// Deal with command line args. 
 	for(int i = 1; i < argc; i++)
 	{
@@ -229,7 +360,34 @@ main (int argc, char *argv[])
 			exit(1);
 		}
 		
-		if(argv[i][0] == '+' || argv[i][0] == '-')
+		if(argv[i][0] == '-' && argv[i][1] == '-')
+		{
+			if(!strcmp(argv[i], "--stats")) show_stats = true;
+			else if(!strncmp(argv[i], "--trace=", 8) && argv[i][8]) trace_file = argv[i] + 8;
+			else if(!strcmp(argv[i], "--calibrate")) calibrate = true;
+			else if(!strcmp(argv[i], "--recalibrate")) calibrate = recalibrate = true;
+			else if(!strcmp(argv[i], "--no-governor")) use_governor = false;
+			else if(!strncmp(argv[i], "--looper=", 9) && argv[i][9]) 
+			{
+				looper_file = argv[i] + 9;
+				efx_looper = true;
+			}
+			else if(!strncmp(argv[i], "--budget=", 9))
+			{
+				budget = strtof(argv[i] + 9, NULL);
+				if(budget <= 0 || budget > 1)
+				{
+					printf("The budget must be between 0 and 1.\n");
+					exit(1);
+				}
+			}
+			else
+			{
+				printf("Unknown option '%s'.\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if(argv[i][0] == '+' || argv[i][0] == '-')
 		{
 			gain = strtof(argv[i],NULL);
 			printf("Gain: %f dB\n", gain);
@@ -246,12 +404,28 @@ main (int argc, char *argv[])
    
 
 	
+	// --- Signals --------------------------------
+	
+	// Ctrl-C or stopping the service ends the main loop instead of killing the process. The signals are blocked 
+	// here, so that every thread started from now on inherits that, and unblocked in this thread just before 
+	// the main loop: they interrupt its ALSA calls instead of landing on one of the other threads.
+	sigset_t quit_signals;
+	sigemptyset(&quit_signals);
+	sigaddset(&quit_signals, SIGINT);
+	sigaddset(&quit_signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &quit_signals, NULL);
+	struct sigaction sa = {0};
+	sa.sa_handler = on_quit_signal; // (no SA_RESTART, so that a blocked read or write returns)
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	
+	
 	// --- Hardware setup --------------------------------
 	snd_pcm_hw_params_t *o_hw_params;
 	snd_pcm_sw_params_t *o_sw_params;
 	snd_pcm_hw_params_t *i_hw_params;
 	snd_pcm_sw_params_t *i_sw_params;
-	snd_pcm_sframes_t frames_to_deliver;
 
 	setup_dev(ODEVICE, &playback_handle, &o_hw_params, &o_sw_params ,SND_PCM_STREAM_PLAYBACK);
 	snd_pcm_hw_params_free (o_hw_params);
@@ -267,6 +441,11 @@ main (int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 	
+	// Flush denormals to zero on this thread, which does all the DSP. Otherwise the filter and delay tails 
+	// get dramatically slower as they die away. The effects also guard their feedback paths, so this isn't fatal.
+	if(-1 == denormal_ftz_set(true))
+		printf("Couldn't enable flush-to-zero: %s\n", strerror(errno));
+	
 	
 	// --- Effects setup --------------------------------
 
@@ -286,9 +465,44 @@ main (int argc, char *argv[])
 	}
 	else // we are using an IR
 	{
-		// LOAD IR
 		char * msg = NULL;
-		int err = convolution_construct(&conv, &msg, &rate, PERIODSZ, argv[av_ir_idx], N);
+		unsigned int ir_max = N;
+		
+		if(calibrate)
+		{
+			// We need the IR's sample rate to know how long a period is, so load it once just to find that out.
+			if(-1 == convolution_construct(&conv, &msg, &rate, PERIODSZ, argv[av_ir_idx], N_MAX))
+			{
+				printf("%s\n", msg);
+				exit(1);
+			}
+			convolution_destruct(&conv);
+			msg = NULL;
+			
+			if(recalibrate || !calibrate_lookup(PERIODSZ, rate, budget, N_MAX, &ir_max))
+			{
+				printf("Calibrating IR length for a %.0f%% budget...\n", 100 * budget);
+				fflush(stdout);
+				int n = calibrate_measure(PERIODSZ, rate, budget, N_MAX);
+				if(n == -1)
+				{
+					printf("Calibration failed: %s\n", strerror(errno));
+					exit(1);
+				}
+				if(n == 0)
+				{
+					printf("This machine can't run the convolution within a %.0f%% budget at all.\n", 100 * budget);
+					exit(1);
+				}
+				ir_max = n;
+				if(-1 == calibrate_store(PERIODSZ, rate, budget, N_MAX, ir_max))
+					printf("Couldn't save the calibration result: %s\n", strerror(errno));
+			}
+			printf("Maximum IR length for this machine: %u samples.\n", ir_max);
+		}
+		
+		// LOAD IR
+		int err = convolution_construct(&conv, &msg, &rate, PERIODSZ, argv[av_ir_idx], ir_max);
 		if(msg != NULL) printf("%s\n",msg);
 		if(err == -1) exit(1);
 		printf("IR '%s' Loaded.\n", argv[av_ir_idx]);
@@ -303,9 +517,32 @@ main (int argc, char *argv[])
 	}
 	
 	
+	// Parametric EQ
+	const struct eq_band eq_bands[] = {
+		{EQ_HIGHPASS, 80, 0.707, 0},
+		{EQ_LOWSHELF, 120, 0.707, 2.0},
+		{EQ_PEAK, 400, 1.0, -3.0}, // mud
+		{EQ_PEAK, 2500, 1.4, 1.5}, // presence
+		{EQ_LOWPASS, 7500, 0.707, 0}, // fizz
+	};
+	eq_t eq;
+	if(-1 == eq_construct(&eq, rate, eq_bands, sizeof(eq_bands)/sizeof(eq_bands[0])))
+	{
+		printf("Failed to create EQ: %s\n", strerror(errno));
+		exit(1);
+	}
+	
+	// Wah (WAH_FIXED for a pedal, WAH_LFO for auto-wah, WAH_ENVELOPE for an envelope filter)
+	wah_t wah;
+	if(-1 == wah_construct(&wah, rate, WAH_ENVELOPE, 1.0))
+	{
+		printf("Failed to create wah: %s\n", strerror(errno));
+		exit(1);
+	}
+	
 	// Tremolo
 	tremolo_t trem;
-	if(-1 == tremolo_construct(&trem, rate, 0.4, lfo(rate, 3.5)))
+	if(-1 == tremolo_construct(&trem, rate, 0.4, lfo(rate, 3.5)) || -1 == tremolo_set_mode(&trem, tremolo_mode))
 	{
 		printf("Failed to create tremolo: %s\n", strerror(errno));
 		exit(1);
@@ -325,6 +562,11 @@ main (int argc, char *argv[])
 		exit(1);
 	}
 	mod.bq = &cfLPF; // we assign a low pass filter to our modulation effect to amek it sound warmer.
+	if(-1 == timeMod_set_interp(&mod, MOD_INTERP))
+	{
+		printf("Failed to set chorus/flange interpolation: %s\n", strerror(errno));
+		exit(1);
+	}
 	
 	// Delay (with lowpass in the feedback loop to make it sound a bit warmer / more analog)
 	// ... lowpass
@@ -341,18 +583,112 @@ main (int argc, char *argv[])
 		printf("Failed to construct delay: %s\n", strerror(errno));
 		exit(1);
 	}
+	
+	// Multi-tap delay: a dotted eighth to the left, a quarter to the right, and a darker half note in the middle.
+	const struct mt_tap mt_taps[] = {
+		{.beats = 0.75, .gain = 0.6, .pan = -0.7},
+		{.beats = 1.0, .gain = 0.5, .pan = 0.7},
+		{.beats = 2.0, .gain = 0.4, .pan = 0.0, .filter_type = BQ_LOWPASS, .filter_freq = 2500},
+	};
+	multitap_t mt;
+	if(-1 == multitap_construct(&mt, rate, 2000.0, mt_taps, sizeof(mt_taps)/sizeof(mt_taps[0]), 120.0, 0.3, 0.5))
+	{
+		printf("Failed to construct multi-tap delay: %s\n", strerror(errno));
+		exit(1);
+	}
+	
+	// Stereo (ping-pong) delay, with the same kind of lowpass in the feedback as the mono delay
+	stereo_delay_t sdly;
+	if(-1 == stereo_delay_construct(&sdly, rate, STEREO_DELAY_PINGPONG, 300.0, 300.0, 0.4, 0.0, 0.4, 1.0, &dlyLPF))
+	{
+		printf("Failed to construct stereo delay: %s\n", strerror(errno));
+		exit(1);
+	}
+	
+	// Ensemble chorus: six voices around 15 ms, spread across the stereo field
+	struct ens_voice ens_voices[6];
+	ensemble_voices(ens_voices, 6, 15.0, 3.0, 0.6, 0.8);
+	ensemble_t ens;
+	if(-1 == ensemble_construct(&ens, rate, ens_voices, 6, 0.5) || -1 == ensemble_set_interp(&ens, MOD_INTERP))
+	{
+		printf("Failed to construct ensemble chorus: %s\n", strerror(errno));
+		exit(1);
+	}
+	
+	// Modulation matrix: a slow sine sweeping the chorus excursion, a slower triangle varying the tremolo depth, 
+	// and the playing level ducking the delay (quieter echoes while playing, which come up in the gaps).
+	// The matrix works at the control rate, and hands each effect a buffer of per-sample values through its port.
+	modmatrix_t mm;
+	if(-1 == modmatrix_construct(&mm, rate, MOD_CTRL, MOD_RAMP_SMOOTH))
+	{
+		printf("Failed to construct modulation matrix: %s\n", strerror(errno));
+		exit(1);
+	}
+	if(modulation)
+	{
+		int sweep = modmatrix_add_lfo(&mm, LFO_SINE, 0.1, 0);
+		int swell = modmatrix_add_lfo(&mm, LFO_TRIANGLE, 0.05, 0);
+		int excursion = modmatrix_add_dest(&mm, mod.excursion, 0, 1);
+		int depth = modmatrix_add_dest(&mm, trem.depth, 0, 1);
+		int mix = modmatrix_add_dest(&mm, dly.mix, 0, 1);
+		if(sweep < 0 || swell < 0 || excursion < 0 || depth < 0 || mix < 0
+			|| -1 == modmatrix_route(&mm, sweep, excursion, 0.15)
+			|| -1 == modmatrix_route(&mm, swell, depth, 0.3)
+			|| -1 == modmatrix_route(&mm, MOD_SRC_ENVELOPE, mix, -1.0))
+		{
+			printf("Failed to set up modulation: %s\n", strerror(errno));
+			exit(1);
+		}
+		mod.excursion_mod = modmatrix_dest(&mm, excursion);
+		trem.depth_mod = modmatrix_dest(&mm, depth);
+		dly.mix_mod = modmatrix_dest(&mm, mix);
+	}
+	
+	// Looper. Only a window of the loop is kept in memory; the rest is in the scratch file (see looper.h).
+	looper_t looper;
+	pthread_t looper_tid;
+	if(efx_looper)
+	{
+		if(-1 == looper_construct(&looper, rate, LOOPER_MAX_SECONDS, looper_file))
+		{
+			printf("Failed to construct looper with '%s': %s\n", looper_file, strerror(errno));
+			exit(1);
+		}
+		if(0 != (errno = pthread_create(&looper_tid, NULL, looper_control_thread, &looper)))
+		{
+			printf("Failed to start looper control thread: %s\n", strerror(errno));
+			exit(1);
+		}
+		printf("Looper: r = record, o = overdub, m = multiply, p = play, s = stop, u = undo, c = clear (then enter).\n");
+	}
+	
+	// Drift compensation
+	resampler_t rs;
+	drift_ctl_t dctl;
+	if(drift_comp)
+	{
+		if(-1 == resampler_construct(&rs, 2, PERIODSZ))
+		{
+			printf("Failed to construct resampler: %s\n", strerror(errno));
+			exit(1);
+		}
+		drift_ctl_reset(&dctl);
+		printf("Drift compensation enabled (capture '%s', playback '%s').\n", IDEVICE, ODEVICE);
+	}
    
    
 	// --- Routing ----------------------------
 	
 	// effects order is:
-	// convolution -> gain -> tremolo -> chorus/flange -> delay 
+	// convolution -> eq -> gain -> lowcut -> wah -> tremolo -> chorus/flange -> delay -> looper -> (stereo from here) multi-tap delay -> ensemble -> (auto-pan) tremolo -> stereo delay
 	
 	// define our buffers
 	float sampsOutL[PERIODSZ];
 	float sampsOutR[PERIODSZ];
 	float garbage[PERIODSZ]; // unused right input channel (guitar plugged into left).
 	float intermediate1[PERIODSZ]; // intermediate buffer used between effects.
+	float resampledL[PERIODSZ + RS_MAX_EXTRA]; // output of the drift compensation stage (length varies by a sample or so each period).
+	float resampledR[PERIODSZ + RS_MAX_EXTRA];
 	
 	for(int i = 0; i < PERIODSZ; i++)
 	{
@@ -373,11 +709,59 @@ main (int argc, char *argv[])
 	if(efx_conv) card_ibufs[0] = convolution_getInputPtr(&conv);
 
 	// these pointers tell the program where to get the L and R output samples.
-	void*  card_obufs[2] = {intermediate1,intermediate1}; 
-	// right now we're using the intermediate buffer as our output buffer.
-	// I used to have a (non-open-source) reverb implemented in here as well, which was a stereo effect. 
-	// The stereo nature of that effect justified the existence of the sampsOutL and sampsOutR buffers
-	// i.e. the input to the reverb was intermediate1 and the output to the card was the aforementioned.
+	void*  card_obufs[2] = {sampsOutL,sampsOutR}; 
+	// The mono effects work on intermediate1. The stereo effects at the end of the chain take that and 
+	// produce sampsOutL and sampsOutR (if none of them are enabled, intermediate1 is just copied to both).
+	
+	// with drift compensation, the card gets the resampled signal instead.
+	if(drift_comp) 
+	{
+		card_obufs[0] = resampledL;
+		card_obufs[1] = resampledR;
+	}
+	
+	
+	// --- Instrumentation ----------------------------
+	
+	// The statistics are published in shared memory, for tools/dspstat.c. If that isn't possible, keep them to ourselves.
+	telemetry_t tm;
+	uint32_t period_ns = 1e9 * PERIODSZ / rate;
+	if(-1 == telemetry_init(&tm, period_ns, TELEM_SHM_NAME))
+	{
+		printf("Couldn't publish statistics in shared memory (%s).\n", strerror(errno));
+		if(-1 == telemetry_init(&tm, period_ns, NULL))
+		{
+			printf("Failed to set up telemetry: %s\n", strerror(errno));
+			exit(1);
+		}
+	}
+	tm.ir_len = efx_conv ? conv.n : 0;
+	
+	governor_t gov;
+	governor_init(&gov, sizeof(shed_levels)/sizeof(shed_levels[0]) - 1, GOV_HIGH, GOV_LOW, GOV_HOLD);
+	bool shed_optional = false;
+	float optional_gain = 1; // how far the optional effects are faded in (1) or out (0)
+	float dryL[PERIODSZ], dryR[PERIODSZ]; // their input, for the fades
+	uint64_t xruns_seen = 0;
+	
+	trace_t trace;
+	if(trace_file)
+	{
+		unsigned int keep = TRACE_KEEP_SECONDS * (rate / PERIODSZ + 1) * (N_STAGES + 2); // (every stage, the period, and an xrun)
+		if(-1 == trace_start(&trace, trace_file, 16, keep))
+		{
+			printf("Failed to start trace '%s': %s\n", trace_file, strerror(errno));
+			exit(1);
+		}
+		tm.trace = &trace;
+		printf("Tracing to '%s' (the last %d seconds before each xrun, and before exiting).\n", trace_file, TRACE_KEEP_SECONDS);
+	}
+	pthread_t stats_tid;
+	if(show_stats && 0 != (errno = pthread_create(&stats_tid, NULL, stats_thread, &tm)))
+	{
+		printf("Failed to start statistics thread: %s\n", strerror(errno));
+		exit(1);
+	}
 	
   
 	// --- Main loop ----------------------------
@@ -385,14 +769,18 @@ main (int argc, char *argv[])
 	int err;
 
 
-	while (1) {
+	pthread_sigmask(SIG_UNBLOCK, &quit_signals, NULL);
+	while (!quit) {
 		
 		// --- Input ----------------------------
 		err = snd_pcm_readn (capture_handle, card_ibufs, PERIODSZ);
+		if(quit) break;
 		
 		if(err < 0) 
 		{ 
 			err = snd_pcm_recover(capture_handle, err, 0);
+			telemetry_xrun(&tm);
+			if(drift_comp) drift_ctl_relock(&dctl);
 		}
 		if(err < 0)
 		{
@@ -404,43 +792,198 @@ main (int argc, char *argv[])
 			printf("Couldn't read what I wanted.\n");
 			break;
 		}
+		telemetry_mark(&tm, STAGE_READ);
 	   
 		// --- Convolution ----------------------------
-		if(efx_conv) convolution_apply(&conv, intermediate1);
+		if(efx_conv) 
+		{
+			convolution_apply(&conv, intermediate1);
+			telemetry_mark(&tm, STAGE_CONV);
+		}
+		
+		// --- EQ ----------------------------
+		if(efx_eq)
+		{
+			eq_apply(&eq, intermediate1, PERIODSZ);
+			telemetry_mark(&tm, STAGE_EQ);
+		}
 		
 		// --- Gain, Tremolo, Chorus/Flange, Delay ----------------------------
 
 		// while convolution needs to operate on a chunk of data at a time, the following effects
-		// can operate one sample at a time. So apply them, sample by sample.
+		// can operate one sample at a time. Each one runs over the whole period in turn, so that we can time them individually.
 		for(int i = 0; i < PERIODSZ; i++)
-		{
 			intermediate1[i] *= gain;
-			if(efx_lowcut) intermediate1[i] = apply_biquad(&LowCutFilt, intermediate1[i]);
-			if(efx_tremolo) intermediate1[i] = tremolo_apply(&trem, intermediate1[i]);
-			if(efx_choflange) intermediate1[i] = timeMod_apply(&mod, intermediate1[i]);
-			if(efx_delay) intermediate1[i] = simple_delay_apply(&dly, intermediate1[i]);
-		   
+		telemetry_mark(&tm, STAGE_GAIN);
+		
+		if(modulation)
+		{
+			modmatrix_run(&mm, intermediate1, PERIODSZ);
+			telemetry_mark(&tm, STAGE_MODMATRIX);
+		}
+		if(efx_lowcut)
+		{
+			apply_biquad_block(&LowCutFilt, intermediate1, intermediate1, PERIODSZ);
+			telemetry_mark(&tm, STAGE_LOWCUT);
+		}
+		if(efx_wah)
+		{
+			wah_apply_block(&wah, intermediate1, PERIODSZ);
+			telemetry_mark(&tm, STAGE_WAH);
+		}
+		
+		// The optional effects fade out when the governor sheds them, and back in when it restores them,
+		// instead of switching (which would click). While they're out, their delay lines are still written.
+		float g0 = optional_gain;
+		float g1 = shed_optional ? fmaxf(0, g0 - 1.0f / SHED_FADE_PERIODS) : fminf(1, g0 + 1.0f / SHED_FADE_PERIODS);
+		optional_gain = g1;
+		bool optional_on = g0 > 0 || g1 > 0;
+		bool optional_fading = g0 < 1 || g1 < 1;
+		
+		if(efx_tremolo && tremolo_mode != TREM_AUTOPAN && optional_on)
+		{
+			if(optional_fading) memcpy(dryL, intermediate1, sizeof(dryL));
+			tremolo_apply_block(&trem, intermediate1, PERIODSZ);
+			if(optional_fading) shed_fade(intermediate1, dryL, g0, g1);
+			telemetry_mark(&tm, STAGE_TREMOLO);
+		}
+		if(efx_choflange)
+		{
+			if(optional_on)
+			{
+				if(optional_fading) memcpy(dryL, intermediate1, sizeof(dryL));
+				timeMod_apply_block(&mod, intermediate1, PERIODSZ);
+				if(optional_fading) shed_fade(intermediate1, dryL, g0, g1);
+			}
+			else
+				timeMod_bypass_block(&mod, intermediate1, PERIODSZ);
+			telemetry_mark(&tm, STAGE_CHOFLANGE);
+		}
+		if(efx_delay)
+		{
+			simple_delay_apply_block(&dly, intermediate1, PERIODSZ);
+			telemetry_mark(&tm, STAGE_DELAY);
+		}
+		if(efx_looper)
+		{
+			looper_apply_block(&looper, intermediate1, PERIODSZ);
+			telemetry_mark(&tm, STAGE_LOOPER);
+		}
+		
+		// --- Stereo effects ----------------------------
+		if(efx_multitap)
+		{
+			multitap_apply_block(&mt, intermediate1, sampsOutL, sampsOutR, PERIODSZ);
+			telemetry_mark(&tm, STAGE_MULTITAP);
+		}
+		else
+		{
+			memcpy(sampsOutL, intermediate1, sizeof(sampsOutL));
+			memcpy(sampsOutR, intermediate1, sizeof(sampsOutR));
+		}
+		if(efx_ensemble)
+		{
+			if(optional_on)
+			{
+				if(optional_fading)
+				{
+					memcpy(dryL, sampsOutL, sizeof(dryL));
+					memcpy(dryR, sampsOutR, sizeof(dryR));
+				}
+				ensemble_apply_block(&ens, sampsOutL, sampsOutR, PERIODSZ);
+				if(optional_fading)
+				{
+					shed_fade(sampsOutL, dryL, g0, g1);
+					shed_fade(sampsOutR, dryR, g0, g1);
+				}
+			}
+			else
+				ensemble_bypass_block(&ens, sampsOutL, sampsOutR, PERIODSZ);
+			telemetry_mark(&tm, STAGE_ENSEMBLE);
+		}
+		if(efx_tremolo && tremolo_mode == TREM_AUTOPAN && optional_on)
+		{
+			if(optional_fading)
+			{
+				memcpy(dryL, sampsOutL, sizeof(dryL));
+				memcpy(dryR, sampsOutR, sizeof(dryR));
+			}
+			tremolo_apply_stereo(&trem, sampsOutL, sampsOutR, PERIODSZ);
+			if(optional_fading)
+			{
+				shed_fade(sampsOutL, dryL, g0, g1);
+				shed_fade(sampsOutR, dryR, g0, g1);
+			}
+			telemetry_mark(&tm, STAGE_TREMOLO);
+		}
+		if(efx_stereodelay)
+		{
+			stereo_delay_apply_block(&sdly, sampsOutL, sampsOutR, PERIODSZ);
+			telemetry_mark(&tm, STAGE_STEREODELAY);
 		}
 		
  
+		// --- Drift compensation ----------------------------
+		int nframes = PERIODSZ;
+		if(drift_comp)
+		{
+			const float * rs_in[2] = {sampsOutL, sampsOutR};
+			float * rs_out[2] = {resampledL, resampledR};
+			nframes = resampler_process(&rs, rs_in, PERIODSZ, rs_out);
+			telemetry_mark(&tm, STAGE_RESAMPLE);
+		}
+ 
 		// --- Output ----------------------------
-		err = snd_pcm_writen (playback_handle, card_obufs, PERIODSZ);
+		err = snd_pcm_writen (playback_handle, card_obufs, nframes);
+		if(quit) break;
 		
 		if(err < 0) 
 		{ 
 			err = snd_pcm_recover(playback_handle, err, 0);
+			telemetry_xrun(&tm);
+			if(drift_comp) drift_ctl_relock(&dctl); // the fill levels jump after a recovery, so re-lock.
 		}
 		if(err < 0) 
 		{
 			printf ("Write failed (%s)\n", snd_strerror (err));
 			break;
 		}
-		else if (err != PERIODSZ)
+		else if (err != nframes)
 		{
 			printf("Couldn't write what I wanted.\n");
 			break;
 		}
-	
+		
+		// Measure how much audio is queued between the two devices, and steer the resampling ratio to hold it steady.
+		if(drift_comp)
+		{
+			snd_pcm_sframes_t odelay = 0;
+			snd_pcm_sframes_t iavail = snd_pcm_avail_update(capture_handle);
+			if(iavail >= 0 && snd_pcm_delay(playback_handle, &odelay) == 0)
+				rs.ratio = drift_ctl_update(&dctl, iavail + odelay);
+		}
+		
+		telemetry_mark(&tm, STAGE_WRITE);
+		telemetry_end_period(&tm);
+		
+		// --- Overload governor ----------------------------
+		bool xrun = tm.stats->xruns != xruns_seen;
+		xruns_seen = tm.stats->xruns;
+		if(use_governor && governor_update(&gov, tm.stats->dsp_ns_last, period_ns, xrun))
+		{
+			// Changes take effect at the start of the next period. 
+			if(efx_conv)
+			{
+				convolution_setActiveLength(&conv, conv.n * shed_levels[gov.level].ir_fraction);
+				tm.ir_len = conv.n_active;
+			}
+			int mod_interp = shed_levels[gov.level].linear_mod ? INTERP_LINEAR : MOD_INTERP;
+			timeMod_set_interp(&mod, mod_interp);
+			ensemble_set_interp(&ens, mod_interp);
+			mod.lofi = shed_levels[gov.level].lofi_mod;
+			shed_optional = shed_levels[gov.level].bypass_optional;
+			tm.shed_level = gov.level;
+		}
 	} 
 
 	
@@ -451,6 +994,30 @@ main (int argc, char *argv[])
 	simple_delay_destruct(&dly);
 	convolution_destruct(&conv);
 	timeMod_destruct(&mod);
+	wah_destruct(&wah);
+	multitap_destruct(&mt);
+	stereo_delay_destruct(&sdly);
+	ensemble_destruct(&ens);
+	modmatrix_destruct(&mm);
+	if(efx_looper)
+	{
+		pthread_cancel(looper_tid);
+		pthread_join(looper_tid, NULL);
+		if(looper_underruns(&looper)) printf("Looper: %u stretches of the loop weren't in memory in time.\n", looper_underruns(&looper));
+		looper_destruct(&looper);
+	}
+	if(drift_comp) resampler_destruct(&rs);
+	
+	if(show_stats) 
+	{
+		pthread_cancel(stats_tid);
+		pthread_join(stats_tid, NULL);
+	}
+	if(trace_file) trace_stop(&trace);
+	struct telemetry_stats snap;
+	telemetry_snapshot(&tm, &snap);
+	telemetry_print(&snap, stdout);
+	telemetry_destruct(&tm);
 	
 	exit (0);
 } 
@@ -0,0 +1,207 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "ensemble.h"
+#include "simd.h"
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+void ensemble_voices(struct ens_voice * voices, int n, float ms, float depth_ms, float rate_hz, float spread)
+{
+	for(int k = 0; k < n; k++)
+	{
+		// s runs from -1 to 1 across the voices; the rates are shuffled so that they don't follow the delays
+		float s = n > 1 ? 2.0f * k / (n - 1) - 1 : 0;
+		float sr = n > 1 ? 2.0f * ((3 * k + 1) % n) / (n - 1) - 1 : 0;
+		voices[k].ms = ms * (1 + 0.4f * s);
+		voices[k].depth_ms = depth_ms;
+		voices[k].rate_hz = rate_hz * (1 + 0.25f * sr);
+		voices[k].phase = (float) k / n;
+		voices[k].pan = n > 1 ? spread * (k % 2 ? 1 : -1) * (1 - (float) (k / 2) / ((n + 1) / 2)) : 0;
+	}
+}
+
+int ensemble_construct(ensemble_t * self, unsigned int samplerate, const struct ens_voice * voices, int nvoices, float mix)
+{
+	if(nvoices < 1 || nvoices > ENS_MAX_VOICES || mix < 0 || mix > 1)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	for(int k = 0; k < nvoices; k++)
+	{
+		if(voices[k].ms < 0 || voices[k].depth_ms < 0 || voices[k].ms + voices[k].depth_ms > ENS_MAX_MS 
+			|| voices[k].rate_hz < 0 || voices[k].pan < -1 || voices[k].pan > 1)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	
+	memset(self->centre, 0, sizeof(self->centre));
+	memset(self->depth, 0, sizeof(self->depth));
+	memset(self->phase, 0, sizeof(self->phase));
+	memset(self->inc, 0, sizeof(self->inc));
+	memset(self->gl, 0, sizeof(self->gl));
+	memset(self->gr, 0, sizeof(self->gr));
+	
+	// constant power panning, scaled so that the voices together are about as loud as the input
+	float g = sqrtf(2.0f / nvoices);
+	for(int k = 0; k < nvoices; k++)
+	{
+		self->centre[k] = voices[k].ms * samplerate / 1000.0f;
+		self->depth[k] = voices[k].depth_ms * samplerate / 1000.0f;
+		self->phase[k] = voices[k].phase - floorf(voices[k].phase);
+		self->inc[k] = voices[k].rate_hz / samplerate;
+		float theta = (voices[k].pan + 1) * (float) M_PI / 4;
+		self->gl[k] = g * cosf(theta);
+		self->gr[k] = g * sinf(theta);
+	}
+	self->nvoices = nvoices;
+	self->ngroups = (nvoices + 3) / 4;
+	self->interp = (interp_t) {INTERP_LAGRANGE3, 0};
+	self->mix = mix;
+	
+	// (each chunk is written before it's read)
+	return ring_construct(&self->ring, ENS_MAX_MS * samplerate / 1000.0f + ENS_BLOCK_MAX + RING_GUARD);
+}
+
+void ensemble_destruct(ensemble_t * self)
+{
+	ring_destruct(&self->ring);
+}
+
+int ensemble_set_interp(ensemble_t * self, int type)
+{
+	if(type != INTERP_LINEAR && type != INTERP_HERMITE && type != INTERP_LAGRANGE3)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	self->interp.type = type;
+	return 0;
+}
+
+void ensemble_apply_block(ensemble_t * self, float * L, float * R, int n)
+{
+	float x[ENS_BLOCK_MAX];
+	float wl[ENS_BLOCK_MAX * 4], wr[ENS_BLOCK_MAX * 4]; // per sample, the voices' output, still in their lanes
+	const ring_t * ring = &self->ring;
+	const float32x4_t one = vdupq_n_f32(1), half = vdupq_n_f32(0.5f), dmin = vdupq_n_f32(ENS_MIN_DELAY);
+	const float mix = self->mix;
+	
+	for(int i = 0; i < n; )
+	{
+		int m = n - i < ENS_BLOCK_MAX ? n - i : ENS_BLOCK_MAX;
+		float * l = L + i;
+		float * r = R + i;
+		i += m;
+		
+		// nothing is fed back, so the chunk can go into the line first
+		for(int j = 0; j < m; j++)
+			x[j] = 0.5f * (l[j] + r[j]);
+		ring_write(&self->ring, x, m);
+		const uint32x4_t base = vdupq_n_u32(ring->w - 2), mask = vdupq_n_u32(ring->mask);
+		
+		for(int g = 0; g < self->ngroups; g++)
+		{
+			float32x4_t ph = vld1q_f32(self->phase + 4*g), inc = vld1q_f32(self->inc + 4*g);
+			const float32x4_t centre = vld1q_f32(self->centre + 4*g), depth = vld1q_f32(self->depth + 4*g);
+			const float32x4_t gl = vld1q_f32(self->gl + 4*g), gr = vld1q_f32(self->gr + 4*g);
+			
+			for(int j = 0; j < m; j++)
+			{
+				// triangle LFO, and the delay it sets (counted from the end of the chunk)
+				ph = vaddq_f32(ph, inc);
+				ph = vbslq_f32(vcgeq_f32(ph, one), vsubq_f32(ph, one), ph);
+				float32x4_t tri = vsubq_f32(one, vmulq_n_f32(vabsq_f32(vsubq_f32(ph, half)), 4));
+				float32x4_t d = vmaxq_f32(vmlsq_f32(centre, depth, tri), dmin);
+				d = vaddq_f32(d, vdupq_n_f32(m - j));
+				
+				// gather the four points around each voice's read position (see ring_points)
+				uint32x4_t di = vcvtq_u32_f32(d);
+				float32x4_t u = vsubq_f32(one, vsubq_f32(d, vcvtq_f32_u32(di)));
+				uint32_t idx[4];
+				vst1q_u32(idx, vandq_u32(vsubq_u32(base, di), mask));
+				float32x4_t r0 = vld1q_f32(ring->buf + idx[0]);
+				float32x4_t r1 = vld1q_f32(ring->buf + idx[1]);
+				float32x4_t r2 = vld1q_f32(ring->buf + idx[2]);
+				float32x4_t r3 = vld1q_f32(ring->buf + idx[3]);
+				transpose4(&r0, &r1, &r2, &r3);
+				
+				float32x4_t y;
+				if(self->interp.type == INTERP_LAGRANGE3)
+					y = lagrange3_q(r0, r1, r2, r3, u);
+				else if(self->interp.type == INTERP_HERMITE)
+					y = hermite_q(r0, r1, r2, r3, u);
+				else
+					y = vfmaq_f32(r1, u, vsubq_f32(r2, r1));
+				if(g == 0)
+				{
+					vst1q_f32(wl + 4*j, vmulq_f32(y, gl));
+					vst1q_f32(wr + 4*j, vmulq_f32(y, gr));
+				}
+				else
+				{
+					vst1q_f32(wl + 4*j, vfmaq_f32(vld1q_f32(wl + 4*j), y, gl));
+					vst1q_f32(wr + 4*j, vfmaq_f32(vld1q_f32(wr + 4*j), y, gr));
+				}
+			}
+			vst1q_f32(self->phase + 4*g, ph);
+		}
+		
+		// add up the lanes (four samples at a time, by transposing), and mix
+		int j = 0;
+		for(; j + 4 <= m; j += 4)
+		{
+			float32x4_t a0 = vld1q_f32(wl + 4*j), a1 = vld1q_f32(wl + 4*j + 4), a2 = vld1q_f32(wl + 4*j + 8), a3 = vld1q_f32(wl + 4*j + 12);
+			float32x4_t b0 = vld1q_f32(wr + 4*j), b1 = vld1q_f32(wr + 4*j + 4), b2 = vld1q_f32(wr + 4*j + 8), b3 = vld1q_f32(wr + 4*j + 12);
+			transpose4(&a0, &a1, &a2, &a3);
+			transpose4(&b0, &b1, &b2, &b3);
+			float32x4_t sl = vaddq_f32(vaddq_f32(a0, a1), vaddq_f32(a2, a3));
+			float32x4_t sr = vaddq_f32(vaddq_f32(b0, b1), vaddq_f32(b2, b3));
+			float32x4_t dl = vld1q_f32(l + j), dr = vld1q_f32(r + j);
+			vst1q_f32(l + j, vfmaq_f32(dl, vdupq_n_f32(mix), vsubq_f32(sl, dl)));
+			vst1q_f32(r + j, vfmaq_f32(dr, vdupq_n_f32(mix), vsubq_f32(sr, dr)));
+		}
+		for(; j < m; j++)
+		{
+			const float * a = wl + 4*j, * b = wr + 4*j;
+			l[j] += mix * (a[0] + a[1] + a[2] + a[3] - l[j]);
+			r[j] += mix * (b[0] + b[1] + b[2] + b[3] - r[j]);
+		}
+	}
+}
+
+void ensemble_bypass_block(ensemble_t * self, const float * L, const float * R, int n)
+{
+	float x[ENS_BLOCK_MAX];
+	for(int i = 0; i < n; )
+	{
+		int m = n - i < ENS_BLOCK_MAX ? n - i : ENS_BLOCK_MAX;
+		for(int j = 0; j < m; j++)
+			x[j] = 0.5f * (L[i + j] + R[i + j]);
+		ring_write(&self->ring, x, m);
+		i += m;
+	}
+	for(int k = 0; k < self->nvoices; k++)
+	{
+		float ph = self->phase[k] + n * self->inc[k];
+		self->phase[k] = ph - floorf(ph);
+	}
+}
@@ -0,0 +1,75 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+// This file and the associated .c contain an ensemble chorus: up to ENS_MAX_VOICES modulated voices reading one 
+// shared delay line, each with its own delay, LFO rate and phase, and stereo position.
+// The voices are computed four at a time, one per lane of a SIMD vector, so several voices cost little more than one.
+
+#include "ring.h"
+
+#define ENS_MAX_VOICES 8
+#define ENS_BLOCK_MAX 256 // processing chunk
+#define ENS_MAX_MS 50.0 // longest delay (plus excursion) a voice can have
+#define ENS_MIN_DELAY 2 // the modulated delays never get shorter than this (samples)
+
+struct ens_voice
+{
+	float ms; // centre delay time
+	float depth_ms; // how far the delay swings either side of ms
+	float rate_hz; // LFO rate
+	float phase; // LFO starting phase, 0 to 1
+	float pan; // -1 (left) to 1 (right)
+};
+
+typedef struct ensemble
+{
+	ring_t ring; // delay line (mono)
+	int nvoices;
+	int ngroups; // vectors of four voices
+	// per voice (lane), in samples and cycles per sample. Unused lanes have no gain.
+	float centre[ENS_MAX_VOICES], depth[ENS_MAX_VOICES];
+	float phase[ENS_MAX_VOICES], inc[ENS_MAX_VOICES];
+	float gl[ENS_MAX_VOICES], gr[ENS_MAX_VOICES];
+	interp_t interp; // see ensemble_set_interp (INTERP_LAGRANGE3 by default)
+	float mix; // 0 to 1
+} ensemble_t;
+
+// Fill voices[0..n-1] with a classic ensemble layout: delays and rates spread around ms and rate_hz, 
+// phases spread evenly, and voices alternating left and right, spread (0 to 1) apart.
+void ensemble_voices(struct ens_voice * voices, int n, float ms, float depth_ms, float rate_hz, float spread);
+
+// nvoices: 1 to ENS_MAX_VOICES. mix: 0 (dry) to 1 (only the voices).
+// returns 0 if ok, -1 and sets errno on an error (EINVAL for bad parameters).
+int ensemble_construct(ensemble_t * self, unsigned int samplerate, const struct ens_voice * voices, int nvoices, float mix);
+
+void ensemble_destruct(ensemble_t * self);
+
+// choose how the voices are interpolated: INTERP_LINEAR, INTERP_HERMITE or INTERP_LAGRANGE3 (interp.h).
+// returns 0 if ok, -1 and sets errno (EINVAL) otherwise: the allpass can't be used, since the voices are read four at a time.
+int ensemble_set_interp(ensemble_t * self, int type);
+
+// process n frames of stereo, in place. The voices are fed the sum of both sides.
+void ensemble_apply_block(ensemble_t * self, float * L, float * R, int n);
+
+// while the effect is bypassed: keep the delay line written (and the LFOs turning), without the cost of the voices, 
+// so that it has no stale audio in it when it's switched back on. L and R are left alone.
+void ensemble_bypass_block(ensemble_t * self, const float * L, const float * R, int n);
+
+#endif
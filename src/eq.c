@@ -0,0 +1,125 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "eq.h"
+#include <errno.h>
+#include <math.h>
+
+int eq_design(struct bq_filter * sections, unsigned int samplerate, const struct eq_band * bands, int nbands)
+{
+	if(nbands < 0 || nbands > EQ_MAX_BANDS)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	for(int i = 0; i < nbands; i++)
+	{
+		const struct eq_band * b = &bands[i];
+		struct bq_filter * s = &sections[i];
+		int err = 0;
+		switch(b->type)
+		{
+			case EQ_OFF:
+				*s = (struct bq_filter) {.cx0 = 1};
+				break;
+			case EQ_PEAK:
+				err = make_biquad_gain(s, BQ_PEAK, b->freq, samplerate, b->Q, b->gain_db);
+				break;
+			case EQ_LOWSHELF:
+				err = make_biquad_gain(s, BQ_LOWSHELF, b->freq, samplerate, b->Q, b->gain_db);
+				break;
+			case EQ_HIGHSHELF:
+				err = make_biquad_gain(s, BQ_HIGHSHELF, b->freq, samplerate, b->Q, b->gain_db);
+				break;
+			case EQ_LOWPASS:
+				err = make_biquad(s, BQ_LOWPASS, b->freq, samplerate, b->Q);
+				break;
+			case EQ_HIGHPASS:
+				err = make_biquad(s, BQ_HIGHPASS, b->freq, samplerate, b->Q);
+				break;
+			case EQ_TILT:
+			{
+				// a high shelf of the full gain, followed by a gain of half the opposite amount.
+				// The gain is folded into the shelf's numerator so that it costs nothing.
+				err = make_biquad_gain(s, BQ_HIGHSHELF, b->freq, samplerate, b->Q, b->gain_db);
+				float g = powf(10.0f, -b->gain_db / 40.0f);
+				s->cx0 *= g;
+				s->cx1 *= g;
+				s->cx2 *= g;
+				break;
+			}
+			default:
+				errno = EINVAL;
+				return -1;
+		}
+		if(err == -1) return -1;
+	}
+	return 0;
+}
+
+int eq_construct(eq_t * self, unsigned int samplerate, const struct eq_band * bands, int nbands)
+{
+	tbuf_init(&self->tb);
+	struct bq_filter * sections = self->slots[tbuf_read_slot(&self->tb)];
+	if(-1 == eq_design(sections, samplerate, bands, nbands)) 
+		return -1;
+	
+	self->samplerate = samplerate;
+	self->nbands = nbands;
+	self->ramp = 0;
+	if(nbands > 0 && -1 == make_biquad_cascade(&self->cascade, sections, nbands))
+		return -1;
+	return 0;
+}
+
+int eq_update(eq_t * self, const struct eq_band * bands, int nbands)
+{
+	if(nbands != self->nbands)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(-1 == eq_design(self->slots[tbuf_write_slot(&self->tb)], self->samplerate, bands, nbands))
+		return -1;
+	tbuf_publish(&self->tb);
+	return 0;
+}
+
+void eq_apply(eq_t * self, float * buf, int n)
+{
+	if(self->nbands == 0) return;
+	
+	if(tbuf_update(&self->tb))
+	{
+		make_biquad_cascade(&self->target, self->slots[tbuf_read_slot(&self->tb)], self->nbands);
+		self->ramp = EQ_RAMP_STEPS;
+	}
+	
+	// While ramping, step the coefficients a fraction of the way every EQ_RAMP_BLOCK samples. 
+	// Every point on a straight line between two stable biquads is itself stable, so this is safe.
+	int i = 0;
+	for(; self->ramp > 0 && i < n; i += EQ_RAMP_BLOCK)
+	{
+		int m = n - i < EQ_RAMP_BLOCK ? n - i : EQ_RAMP_BLOCK;
+		bq_cascade_lerp(&self->cascade, &self->target, 1.0f / self->ramp);
+		self->ramp--;
+		apply_biquad_cascade(&self->cascade, buf + i, buf + i, m);
+	}
+	if(i < n)
+		apply_biquad_cascade(&self->cascade, buf + i, buf + i, n - i);
+}
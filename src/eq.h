@@ -0,0 +1,79 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef EQ_H
+#define EQ_H
+
+// This file and the associated .c contain a parametric equalizer: up to EQ_MAX_BANDS peaking, shelving, 
+// low/high pass and tilt bands. The bands are designed into a biquad cascade, which does the actual work.
+// Designing the filters is relatively expensive, so do it outside the realtime loop: eq_update designs new 
+// coefficients on the calling (control) thread and hands them to the audio thread lock-free, which then 
+// ramps to them over EQ_RAMP_STEPS * EQ_RAMP_BLOCK samples, so changing the EQ while playing doesn't click.
+
+#include "biquad_filt.h"
+#include "tbuf.h"
+#include <stdbool.h>
+
+#define EQ_MAX_BANDS 10
+#define EQ_RAMP_BLOCK 16 // samples between coefficient steps while ramping
+#define EQ_RAMP_STEPS 16
+
+// band types
+#define EQ_OFF 0 // band does nothing
+#define EQ_PEAK 1 // boost or cut around freq
+#define EQ_LOWSHELF 2 // boost or cut everything below freq
+#define EQ_HIGHSHELF 3 // boost or cut everything above freq
+#define EQ_LOWPASS 4
+#define EQ_HIGHPASS 5
+#define EQ_TILT 6 // tilt the spectrum around freq: the highs go up by gain_db/2 and the lows down by as much (or vice versa)
+
+struct eq_band
+{
+	int type;
+	float freq; // Hz
+	float Q; // bandwidth of the peaking filters, slope of the others (0.707 if in doubt)
+	float gain_db; // ignored by the low and high pass filters
+};
+
+typedef struct eq
+{
+	bq_cascade_t cascade; // in use
+	bq_cascade_t target; // coefficients being ramped to
+	int ramp; // remaining ramp steps
+	struct bq_filter slots[3][EQ_MAX_BANDS]; // designs handed over by tb
+	tbuf_t tb;
+	int nbands;
+	unsigned int samplerate;
+} eq_t;
+
+// design one section per band. Bands that are EQ_OFF get a section that passes the signal unchanged.
+// returns 0 if ok, or -1 and sets errno (EINVAL) if a band is invalid.
+int eq_design(struct bq_filter * sections, unsigned int samplerate, const struct eq_band * bands, int nbands);
+
+// returns 0 if ok, -1 and sets errno on an error.
+// The number of bands is fixed from here on (use EQ_OFF for bands that may be switched on later).
+int eq_construct(eq_t * self, unsigned int samplerate, const struct eq_band * bands, int nbands);
+
+// change the bands while the EQ is running. nbands must be the same as given to eq_construct.
+// Called from one control thread at a time (not the audio thread); never blocks.
+// returns 0 if ok, -1 and sets errno (EINVAL) on an error.
+int eq_update(eq_t * self, const struct eq_band * bands, int nbands);
+
+// equalize n samples in place
+void eq_apply(eq_t * self, float * buf, int n);
+
+#endif
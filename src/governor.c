@@ -0,0 +1,81 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "governor.h"
+#include <errno.h>
+
+#define GOV_COOLDOWN 16 // periods between successive degradation steps
+#define GOV_MAX_BACKOFF_FACTOR 16 // the hold time can grow to this multiple of the configured one
+
+int governor_init(governor_t * self, unsigned int max_level, float high, float low, unsigned int hold)
+{
+	if(low <= 0 || high <= low || hold == 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	self->high = high;
+	self->low = low;
+	self->hold = hold;
+	self->max_level = max_level;
+	self->level = 0;
+	self->calm = 0;
+	self->cooldown = 0;
+	self->since_restore = hold * GOV_MAX_BACKOFF_FACTOR + 1;
+	self->backoff = hold;
+	return 0;
+}
+
+bool governor_update(governor_t * self, uint64_t dsp_ns, uint32_t period_ns, bool xrun)
+{
+	float load = (float) dsp_ns / period_ns;
+	
+	if(self->cooldown > 0) self->cooldown--;
+	if(self->since_restore <= self->hold * GOV_MAX_BACKOFF_FACTOR) self->since_restore++;
+	
+	if(load > self->high || xrun)
+	{
+		self->calm = 0;
+		if(self->cooldown > 0 || self->level == self->max_level) return false;
+		
+		// If we only just restored this level, it evidently couldn't be afforded. Wait longer next time.
+		if(self->since_restore < self->backoff && self->backoff < self->hold * GOV_MAX_BACKOFF_FACTOR)
+			self->backoff *= 2;
+		
+		self->level++;
+		self->cooldown = GOV_COOLDOWN;
+		return true;
+	}
+	
+	if(load < self->low)
+	{
+		if(++self->calm >= self->backoff && self->level > 0)
+		{
+			self->level--;
+			self->calm = 0;
+			self->since_restore = 0;
+			return true;
+		}
+	}
+	else self->calm = 0;
+	
+	// a long stretch without trouble resets the backoff
+	if(self->since_restore > self->hold * GOV_MAX_BACKOFF_FACTOR) self->backoff = self->hold;
+	
+	return false;
+}
@@ -0,0 +1,52 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+// This file and the associated .c contain an overload governor ("load shedding").
+//
+// It watches how long the DSP takes each period. When that approaches the deadline (because of another process,
+// thermal throttling, ...) it raises the degradation level, and the engine responds by making the processing 
+// cheaper (see dsp.c). When there is plenty of headroom again, the level is lowered one step at a time, with 
+// hysteresis so that we don't oscillate between levels. A slightly simpler tone is much better than clicks.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct governor
+{
+	float high; // degrade when a period's DSP time exceeds this fraction of the period (or on an xrun)
+	float low; // restore one level when the DSP time has stayed below this fraction of the period...
+	unsigned int hold; // ...for this many consecutive periods
+	unsigned int max_level;
+	
+	unsigned int level; // current degradation level. 0 = full quality
+	unsigned int calm; // consecutive periods below low
+	unsigned int cooldown; // periods left before we may degrade again (the previous step needs time to take effect)
+	unsigned int since_restore; // periods since the level was last lowered
+	unsigned int backoff; // current hold time. Grows if restoring keeps causing overloads
+} governor_t;
+
+// returns 0 on success, -1 and sets errno on failure (bad thresholds).
+int governor_init(governor_t * self, unsigned int max_level, float high, float low, unsigned int hold);
+
+// call once per period. dsp_ns: DSP time of the period just finished. xrun: whether it had an xrun.
+// returns true if the level changed.
+bool governor_update(governor_t * self, uint64_t dsp_ns, uint32_t period_ns, bool xrun);
+
+#endif
@@ -0,0 +1,90 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef INTERP_H
+#define INTERP_H
+
+// Interpolators for reading a delay line between samples (fractional delays).
+// Each takes p, pointing at four consecutive samples p[0..3] (oldest first), and u, the position 
+// between p[1] and p[2] (0 = p[1], 1 = p[2]).
+//	linear - cheapest; dulls the highs a little when u is near 0.5
+//	hermite - cubic Hermite (Catmull-Rom); much less dulling and modulation noise than linear, a little cheaper than lagrange3
+//	lagrange3 - third order Lagrange; flatter and less noisy, about twice the cost
+//	thiran - first order allpass; perfectly flat magnitude, but it has state (so it's best for delays that 
+//		move slowly, and the state should be reset when the read position jumps)
+
+#define INTERP_LINEAR 0
+#define INTERP_LAGRANGE3 1
+#define INTERP_THIRAN 2
+#define INTERP_HERMITE 3
+
+typedef struct interp
+{
+	int type; // one of the above
+	float y1; // thiran state
+} interp_t;
+
+static inline float interp_linear(const float * p, float u)
+{
+	return p[1] + u * (p[2] - p[1]);
+}
+
+static inline float interp_lagrange3(const float * p, float u)
+{
+	float um1 = u - 1, um2 = u - 2, up1 = u + 1;
+	return -u * um1 * um2 * (1.0f/6) * p[0] + up1 * um1 * um2 * 0.5f * p[1] 
+		- up1 * u * um2 * 0.5f * p[2] + up1 * u * um1 * (1.0f/6) * p[3];
+}
+
+static inline float interp_hermite(const float * p, float u)
+{
+	float c1 = 0.5f * (p[2] - p[0]);
+	float c2 = p[0] - 2.5f * p[1] + 2 * p[2] - 0.5f * p[3];
+	float c3 = 0.5f * (p[3] - p[0]) + 1.5f * (p[1] - p[2]);
+	return ((c3 * u + c2) * u + c1) * u + p[1];
+}
+
+static inline float interp_thiran(const float * p, float u, float * y1)
+{
+	// The allpass is accurate for delays between 0.5 and 1.5 samples, so count from p[3] or p[2] accordingly.
+	float x0, x1, delta;
+	if(u > 0.5f)
+	{
+		x0 = p[3]; x1 = p[2]; delta = 2 - u;
+	}
+	else
+	{
+		x0 = p[2]; x1 = p[1]; delta = 1 - u;
+	}
+	float a = (1 - delta) / (1 + delta);
+	float y = a * (x0 - *y1) + x1;
+	*y1 = y;
+	return y;
+}
+
+static inline float interp_read(interp_t * self, const float * p, float u)
+{
+	switch(self->type)
+	{
+		case INTERP_LAGRANGE3: return interp_lagrange3(p, u);
+		case INTERP_THIRAN: return interp_thiran(p, u, &self->y1);
+		case INTERP_HERMITE: return interp_hermite(p, u);
+		default: return interp_linear(p, u);
+	}
+}
+
+#endif
@@ -0,0 +1,306 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "lfo.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+
+#define PHASE_BITS 32
+#define FRAC_BITS (PHASE_BITS - LFO_TABLE_BITS)
+
+static uint32_t phase_inc(unsigned int samplerate, float freq_hz)
+{
+	return (uint32_t) (freq_hz / samplerate * 4294967296.0 + 0.5);
+}
+
+lfo_t lfo(unsigned int samplerate, float freq_hz)
+{
+	lfo_t self;
+	self.phase = 0;
+	self.inc = phase_inc(samplerate, freq_hz);
+	return self;
+}
+
+float lfo_next(lfo_t * self)
+{
+	float val = lfo_sin(self->phase);
+	self->phase += self->inc;
+	return val;
+}
+
+float lfo_next_tri(lfo_t * self)
+{
+	float val = lfo_tri(self->phase);
+	self->phase += self->inc;
+	return val;
+}
+
+void lfo_block_tri(lfo_t * self, float * out, int n)
+{
+	uint32_t phase = self->phase;
+	for(int i = 0; i < n; i++)
+	{
+		out[i] = lfo_tri(phase);
+		phase += self->inc;
+	}
+	self->phase = phase;
+}
+
+
+void lfo_block(lfo_t * self, float * out, int n)
+{
+	uint32_t phase = self->phase;
+	int i = 0;
+	if(n >= 4)
+	{
+		// lfo_sin on four consecutive phases. The triangle is 1 - |4y - 2|, where y is the phase a quarter cycle on.
+		const uint32_t lanes[4] = {0, self->inc, 2 * self->inc, 3 * self->inc};
+		uint32x4_t ph = vaddq_u32(vdupq_n_u32(phase + (1u << 30)), vld1q_u32(lanes));
+		const uint32x4_t step = vdupq_n_u32(4 * self->inc);
+		for(; i + 4 <= n; i += 4)
+		{
+			float32x4_t y = vmulq_n_f32(vcvtq_f32_u32(ph), 4.0f / 4294967296.0f);
+			float32x4_t t = vsubq_f32(vdupq_n_f32(1), vabsq_f32(vsubq_f32(y, vdupq_n_f32(2))));
+			float32x4_t t2 = vmulq_f32(t, t);
+			float32x4_t p = vfmaq_f32(vdupq_n_f32(-0.64170f), t2, vdupq_n_f32(0.07146f));
+			p = vfmaq_f32(vdupq_n_f32(1.57024f), t2, p);
+			vst1q_f32(out + i, vmulq_f32(t, p));
+			ph = vaddq_u32(ph, step);
+		}
+		phase += i * self->inc;
+	}
+	for(; i < n; i++)
+	{
+		out[i] = lfo_sin(phase);
+		phase += self->inc;
+	}
+	self->phase = phase;
+}
+
+
+// -- bank --
+
+// Band-limited square and saw: the Fourier series up to this harmonic, with Lanczos sigma factors 
+// (so they don't overshoot), normalized to a peak of 1.
+#define LFO_HARMONICS 24
+
+static void make_table(float * t, int shape)
+{
+	for(int i = 0; i < LFO_TABLE_SIZE; i++)
+	{
+		double x = 2 * M_PI * i / LFO_TABLE_SIZE;
+		double v = 0;
+		switch(shape)
+		{
+			case LFO_SINE: v = sin(x); break;
+			case LFO_TRIANGLE: v = lfo_tri((uint32_t) i << FRAC_BITS); break;
+			case LFO_SQUARE:
+			case LFO_SAW:
+				for(int k = 1; k <= LFO_HARMONICS; k++)
+				{
+					if(shape == LFO_SQUARE && k % 2 == 0) continue;
+					double sigma = sin(M_PI * k / (LFO_HARMONICS + 1)) / (M_PI * k / (LFO_HARMONICS + 1));
+					v += sigma * sin(k * x) / k * (shape == LFO_SAW && k % 2 == 0 ? -1 : 1);
+				}
+				break;
+			case LFO_RANDOM: v = 0.5 - 0.5 * cos(x / 2); break; // (a raised cosine ramp from 0 to 1, for gliding between values)
+			default: v = 0;
+		}
+		t[i] = v;
+	}
+	t[LFO_TABLE_SIZE] = t[0];
+	
+	if(shape == LFO_SQUARE || shape == LFO_SAW)
+	{
+		float peak = 0;
+		for(int i = 0; i < LFO_TABLE_SIZE; i++)
+			if(fabsf(t[i]) > peak) peak = fabsf(t[i]);
+		for(int i = 0; i <= LFO_TABLE_SIZE; i++)
+			t[i] /= peak;
+	}
+	if(shape == LFO_RANDOM) 
+		t[LFO_TABLE_SIZE] = 1; // (the ramp doesn't wrap)
+}
+
+static float next_random(uint32_t * seed)
+{
+	// xorshift32
+	uint32_t x = *seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed = x;
+	return (float) x * (2.0f / 4294967296.0f) - 1;
+}
+
+// the random shapes get a new value at the start of each cycle
+static void new_cycle(lfo_bank_t * self, int k)
+{
+	float prev = self->rnd[k];
+	self->rnd[k] = next_random(&self->seed[k]);
+	if(self->shape[k] == LFO_SAMPLE_HOLD)
+		self->a[k] = self->rnd[k];
+	else
+	{
+		self->a[k] = prev;
+		self->b[k] = self->rnd[k] - prev;
+	}
+}
+
+int lfo_bank_construct(lfo_bank_t * self, unsigned int samplerate)
+{
+	self->tables = malloc(LFO_SHAPES * (LFO_TABLE_SIZE + 1) * sizeof(float));
+	if(!self->tables) return -1;
+	for(int s = 0; s < LFO_SHAPES; s++)
+		make_table(self->tables + s * (LFO_TABLE_SIZE + 1), s);
+	
+	self->n = 0;
+	self->samplerate = samplerate;
+	// the unused lanes read the (silent) sample & hold table
+	for(int k = 0; k < LFO_BANK_MAX; k++)
+	{
+		self->phase[k] = self->inc[k] = 0;
+		self->table[k] = LFO_SAMPLE_HOLD * (LFO_TABLE_SIZE + 1);
+		self->a[k] = self->b[k] = 0;
+	}
+	return 0;
+}
+
+void lfo_bank_destruct(lfo_bank_t * self)
+{
+	free(self->tables);
+}
+
+int lfo_bank_add(lfo_bank_t * self, int shape, float freq_hz, float phase)
+{
+	if(shape < 0 || shape >= LFO_SHAPES || freq_hz < 0 || freq_hz >= self->samplerate / 2.0f)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(self->n == LFO_BANK_MAX)
+	{
+		errno = ENOSPC;
+		return -1;
+	}
+	
+	int k = self->n++;
+	self->shape[k] = shape;
+	self->phase[k] = (uint32_t) ((phase - floorf(phase)) * 4294967296.0);
+	self->inc[k] = phase_inc(self->samplerate, freq_hz);
+	self->table[k] = shape * (LFO_TABLE_SIZE + 1);
+	self->a[k] = 0;
+	self->b[k] = 1;
+	self->seed[k] = 0x9e3779b9u * (k + 1);
+	self->rnd[k] = next_random(&self->seed[k]);
+	if(shape == LFO_SAMPLE_HOLD || shape == LFO_RANDOM)
+		new_cycle(self, k);
+	return k;
+}
+
+void lfo_bank_set_rate(lfo_bank_t * self, int k, float freq_hz)
+{
+	self->inc[k] = phase_inc(self->samplerate, freq_hz);
+}
+
+// m samples of four LFOs, none of which starts a new random value along the way. out: four per sample.
+static void run_group(lfo_bank_t * self, int g, float * out, int m)
+{
+	uint32x4_t ph = vld1q_u32(self->phase + 4*g);
+	const uint32x4_t inc = vld1q_u32(self->inc + 4*g), table = vld1q_u32(self->table + 4*g);
+	const uint32x4_t fmask = vdupq_n_u32((1u << FRAC_BITS) - 1);
+	const float32x4_t a = vld1q_f32(self->a + 4*g), b = vld1q_f32(self->b + 4*g);
+	
+	for(int j = 0; j < m; j++)
+	{
+		// gather the two table entries around each phase
+		uint32_t pos[4];
+		vst1q_u32(pos, vaddq_u32(table, vshrq_n_u32(ph, FRAC_BITS)));
+		float32x4_t lo = vcombine_f32(vld1_f32(self->tables + pos[0]), vld1_f32(self->tables + pos[1]));
+		float32x4_t hi = vcombine_f32(vld1_f32(self->tables + pos[2]), vld1_f32(self->tables + pos[3]));
+		float32x4x2_t t = vuzpq_f32(lo, hi);
+		float32x4_t frac = vmulq_n_f32(vcvtq_f32_u32(vandq_u32(ph, fmask)), 1.0f / (1u << FRAC_BITS));
+		
+		float32x4_t y = vfmaq_f32(t.val[0], frac, vsubq_f32(t.val[1], t.val[0]));
+		vst1q_f32(out + 4*j, vfmaq_f32(a, b, y));
+		ph = vaddq_u32(ph, inc);
+	}
+	vst1q_u32(self->phase + 4*g, ph);
+}
+
+void lfo_bank_run(lfo_bank_t * self, float * const * out, int n)
+{
+	float tmp[LFO_BLOCK_MAX * 4];
+	
+	for(int g = 0; g < (self->n + 3) / 4; g++)
+	{
+		float * o[4];
+		for(int l = 0; l < 4; l++)
+			o[l] = 4*g + l < self->n ? out[4*g + l] : NULL;
+		
+		for(int i = 0; i < n; )
+		{
+			int m = n - i < LFO_BLOCK_MAX ? n - i : LFO_BLOCK_MAX;
+			
+			for(int j = 0; j < m; )
+			{
+				// run up to the next sample where a random LFO starts a new cycle
+				int seg = m - j;
+				int wraps[4] = {0};
+				for(int l = 0; l < 4; l++)
+				{
+					int k = 4*g + l;
+					if(k >= self->n || self->inc[k] == 0 || (self->shape[k] != LFO_SAMPLE_HOLD && self->shape[k] != LFO_RANDOM))
+						continue;
+					uint64_t s = ((1ull << PHASE_BITS) - self->phase[k] + self->inc[k] - 1) / self->inc[k];
+					if(s <= (uint64_t) seg)
+					{
+						if(s < (uint64_t) seg)
+						{
+							seg = s;
+							for(int q = 0; q < l; q++) wraps[q] = 0;
+						}
+						wraps[l] = 1;
+					}
+				}
+				run_group(self, g, tmp + 4*j, seg);
+				j += seg;
+				for(int l = 0; l < 4; l++)
+					if(wraps[l]) new_cycle(self, 4*g + l);
+			}
+			
+			// from four per sample to one buffer per LFO
+			int j = 0;
+			for(; j + 4 <= m; j += 4)
+			{
+				float32x4_t r0 = vld1q_f32(tmp + 4*j), r1 = vld1q_f32(tmp + 4*j + 4);
+				float32x4_t r2 = vld1q_f32(tmp + 4*j + 8), r3 = vld1q_f32(tmp + 4*j + 12);
+				transpose4(&r0, &r1, &r2, &r3);
+				if(o[0]) vst1q_f32(o[0] + i + j, r0);
+				if(o[1]) vst1q_f32(o[1] + i + j, r1);
+				if(o[2]) vst1q_f32(o[2] + i + j, r2);
+				if(o[3]) vst1q_f32(o[3] + i + j, r3);
+			}
+			for(; j < m; j++)
+				for(int l = 0; l < 4; l++)
+					if(o[l]) o[l][i + j] = tmp[4*j + l];
+			i += m;
+		}
+	}
+}
@@ -0,0 +1,103 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef LFO_H
+#define LFO_H
+
+// This file and the associated .c contain the low-frequency oscillators.
+// Both kinds keep their phase in a 32 bit accumulator: a full cycle is 2^32, so the phase wraps by itself 
+// (unsigned overflow), and the frequency resolution is better than 0.0001 Hz.
+//	lfo_t - a single sine or triangle LFO owned by an effect, computed from the phase with a few multiplies.
+//	lfo_bank_t - up to LFO_BANK_MAX LFOs of any shape (LFO_ constants), computed four at a time in the lanes 
+//		of a SIMD vector and a block at a time. The shapes come from wavetables (band-limited, so that the 
+//		square and saw don't click), or from a random generator for the sample & hold and smooth random shapes.
+
+#include <stdint.h>
+
+typedef struct lfo
+{
+	uint32_t phase;
+	uint32_t inc; // phase increment per sample
+} lfo_t;
+
+lfo_t lfo(unsigned int samplerate, float freq_hz); // lfo constructor
+float lfo_next(lfo_t * self); // get next value from the LFO (called every interval of the sample rate). sinusoidal.
+float lfo_next_tri(lfo_t * self); // same as above but triangle wave.
+// the next n values of lfo_next_tri
+void lfo_block_tri(lfo_t * self, float * out, int n);
+// the next n values of lfo_next, four at a time
+void lfo_block(lfo_t * self, float * out, int n);
+
+// triangle (-1 to 1, starting at 0 and rising) at a phase
+static inline float lfo_tri(uint32_t phase)
+{
+	float x = phase * (1.0f / 4294967296.0f);
+	return x < 0.25f ? 4 * x : x < 0.75f ? 2 - 4 * x : 4 * x - 4;
+}
+
+// sine at a phase: sin(pi/2 * triangle), by a fitted fifth order polynomial (error under 2e-4, peaks at exactly 1)
+static inline float lfo_sin(uint32_t phase)
+{
+	float t = lfo_tri(phase), t2 = t * t;
+	return t * (1.57024f + t2 * (-0.64170f + t2 * 0.07146f));
+}
+
+
+#define LFO_BANK_MAX 8
+#define LFO_TABLE_BITS 10
+#define LFO_TABLE_SIZE (1 << LFO_TABLE_BITS) // samples per cycle in the wavetables
+#define LFO_BLOCK_MAX 256 // lfo_bank_run works in chunks of up to this many samples
+
+// shapes (all -1 to 1)
+#define LFO_SINE 0
+#define LFO_TRIANGLE 1
+#define LFO_SQUARE 2
+#define LFO_SAW 3 // rising
+#define LFO_SAMPLE_HOLD 4 // a new random value each cycle
+#define LFO_RANDOM 5 // glides smoothly from one random value to the next each cycle
+#define LFO_SHAPES 6
+
+typedef struct lfo_bank
+{
+	float * tables; // one wavetable (LFO_TABLE_SIZE + 1 samples, the last repeating the first) per shape
+	int n; // LFOs in use
+	int shape[LFO_BANK_MAX];
+	// per LFO (lane). Each output is a + b * (its table, interpolated at its phase).
+	uint32_t phase[LFO_BANK_MAX], inc[LFO_BANK_MAX];
+	uint32_t table[LFO_BANK_MAX]; // offset of the LFO's table in tables
+	float a[LFO_BANK_MAX], b[LFO_BANK_MAX];
+	float rnd[LFO_BANK_MAX]; // the random shapes' current value
+	uint32_t seed[LFO_BANK_MAX];
+	unsigned int samplerate;
+} lfo_bank_t;
+
+// an empty bank. returns 0 if ok, -1 and sets errno on an error.
+int lfo_bank_construct(lfo_bank_t * self, unsigned int samplerate);
+
+void lfo_bank_destruct(lfo_bank_t * self);
+
+// add an LFO. phase: where in its cycle it starts (0 to 1).
+// returns its index in the bank, or -1 and sets errno (EINVAL for a bad shape or rate, ENOSPC if the bank is full).
+int lfo_bank_add(lfo_bank_t * self, int shape, float freq_hz, float phase);
+
+// change an LFO's rate (its phase carries on from where it is)
+void lfo_bank_set_rate(lfo_bank_t * self, int k, float freq_hz);
+
+// out[k][0..n-1] = the next n values of LFO k, for each LFO in the bank (out[k] may be NULL to skip one)
+void lfo_bank_run(lfo_bank_t * self, float * const * out, int n);
+
+#endif
@@ -0,0 +1,716 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "looper.h"
+#include "denormal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+// Linux/POSIX
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// A slot may only be touched by whichever thread moved it out of SLOT_READY (with a compare-and-swap), 
+// except that the I/O thread may change a slot's tags while the epoch that the audio thread is looking for 
+// isn't in any of them (the audio thread checks the tags before it uses a slot, and then lets go).
+enum { SLOT_READY, SLOT_AUDIO, SLOT_IO };
+
+enum { EV_CLEAR, EV_RECORD, EV_LAYER, EV_UNDO, EV_SNAPSHOT };
+
+#define NO_CHUNK 0xffffffffu
+
+// the first LOOPER_HEAD chunks each have their own slot. The rest share the ring slots, LOOPER_RING chunks apart.
+static inline unsigned int slot_of(unsigned int chunk)
+{
+	return chunk < LOOPER_HEAD ? chunk : LOOPER_HEAD + (chunk - LOOPER_HEAD) % LOOPER_RING;
+}
+
+
+// --- Audio thread ----------------------------
+
+static bool post(looper_t * self, uint32_t type, uint32_t layer, uint32_t chunk, uint32_t arg)
+{
+	unsigned int head = atomic_load_explicit(&self->ev_head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&self->ev_tail, memory_order_acquire);
+	if(head - tail >= LOOPER_EVENTS)
+	{
+		atomic_fetch_add_explicit(&self->dropped, 1, memory_order_relaxed);
+		return false;
+	}
+	self->events[head & (LOOPER_EVENTS - 1)] = (struct looper_event) {type, layer, chunk, arg};
+	atomic_store_explicit(&self->ev_head, head + 1, memory_order_release);
+	return true;
+}
+
+static void release(looper_t * self)
+{
+	if(self->held < 0) return;
+	atomic_store_explicit(&self->slots[self->held].state, SLOT_READY, memory_order_release);
+	self->held = -1;
+}
+
+// the slot holding a chunk, or NULL if the I/O thread hasn't got it ready (or is busy with it)
+static struct looper_slot * acquire(looper_t * self, unsigned int chunk)
+{
+	if(self->held >= 0)
+	{
+		if(self->slots[self->held].chunk == chunk) return &self->slots[self->held];
+		release(self);
+	}
+	atomic_store_explicit(&self->pub_pos, chunk, memory_order_relaxed);
+	
+	int s = slot_of(chunk);
+	struct looper_slot * sl = &self->slots[s];
+	unsigned int expect = SLOT_READY;
+	if(!atomic_compare_exchange_strong_explicit(&sl->state, &expect, SLOT_AUDIO, memory_order_acquire, memory_order_relaxed))
+		return NULL;
+	if(sl->chunk != chunk || sl->epoch != self->epoch)
+	{
+		atomic_store_explicit(&sl->state, SLOT_READY, memory_order_release);
+		return NULL;
+	}
+	self->held = s;
+	return sl;
+}
+
+// About to change a slot on behalf of the current layer. If it holds changes from an earlier layer that haven't 
+// been written out, a copy of them goes to the I/O thread first, so that undo can get back to them.
+static void touch(looper_t * self, struct looper_slot * sl)
+{
+	if(sl->dirty && sl->layer != self->layer)
+	{
+		int i = 0;
+		while(i < LOOPER_SNAPSHOTS && atomic_load_explicit(&self->snap_busy[i], memory_order_acquire)) i++;
+		if(i == LOOPER_SNAPSHOTS)
+			atomic_fetch_add_explicit(&self->dropped, 1, memory_order_relaxed);
+		else
+		{
+			memcpy(self->snap[i], sl->data, LOOPER_CHUNK * sizeof(float));
+			atomic_store_explicit(&self->snap_busy[i], true, memory_order_relaxed);
+			if(!post(self, EV_SNAPSHOT, sl->layer, sl->chunk, i))
+				atomic_store_explicit(&self->snap_busy[i], false, memory_order_relaxed);
+		}
+	}
+	sl->dirty = true;
+	sl->layer = self->layer;
+}
+
+static bool clear(looper_t * self)
+{
+	if(!post(self, EV_CLEAR, 0, 0, self->epoch + 1)) return false;
+	release(self);
+	self->epoch++;
+	self->mode = LOOPER_EMPTY;
+	self->k = self->r = 0;
+	self->len0 = self->nc0 = self->cycles = 0;
+	self->depth = 0;
+	atomic_store_explicit(&self->pub_pos, 0, memory_order_relaxed);
+	return true;
+}
+
+static bool start_layer(looper_t * self, bool multiply)
+{
+	if(!post(self, EV_LAYER, self->next_layer, 0, multiply)) return false;
+	if(self->depth == LOOPER_UNDO_LEVELS)
+	{
+		// the oldest overdub can't be undone any more (the I/O thread merges it into the recording)
+		memmove(self->kstack, self->kstack + 1, LOOPER_UNDO_LEVELS * sizeof(unsigned int));
+		memmove(self->lstack, self->lstack + 1, LOOPER_UNDO_LEVELS * sizeof(unsigned int));
+		self->depth--;
+	}
+	self->depth++;
+	self->kstack[self->depth] = self->cycles;
+	self->lstack[self->depth] = self->layer = self->next_layer++;
+	return true;
+}
+
+static bool undo(looper_t * self)
+{
+	if(self->mode == LOOPER_RECORDING) return clear(self);
+	if(self->depth == 0)
+	{
+		if(self->mode != LOOPER_STOPPED) self->mode = LOOPER_PLAYING;
+		return true;
+	}
+	if(!post(self, EV_UNDO, self->layer, 0, self->epoch + 1)) return false;
+	release(self);
+	self->epoch++;
+	self->depth--;
+	self->cycles = self->kstack[self->depth];
+	self->layer = self->lstack[self->depth];
+	self->k %= self->cycles;
+	if(self->fresh_from > self->cycles) self->fresh_from = self->cycles;
+	if(self->mode != LOOPER_STOPPED) self->mode = LOOPER_PLAYING;
+	return true;
+}
+
+// finish recording: the loop is what has been recorded so far. Returns false if that was too short to keep.
+static bool close_loop(looper_t * self)
+{
+	if(self->r < self->min_len)
+	{
+		clear(self);
+		return false;
+	}
+	self->len0 = self->r;
+	self->nc0 = (self->r + LOOPER_CHUNK - 1) / LOOPER_CHUNK;
+	self->cycles = self->fresh_from = 1;
+	self->kstack[0] = 1;
+	self->k = self->r = 0;
+	self->mode = LOOPER_PLAYING;
+	self->fade = 1;
+	return true;
+}
+
+static void command(looper_t * self, int cmd)
+{
+	switch(cmd)
+	{
+		case LOOPER_RECORD:
+			if(self->mode == LOOPER_EMPTY)
+			{
+				if(!post(self, EV_RECORD, self->next_layer, 0, 0)) break;
+				self->lstack[0] = self->layer = self->next_layer++;
+				self->depth = 0;
+				self->k = self->r = 0;
+				self->mode = LOOPER_RECORDING;
+			}
+			else if(self->mode == LOOPER_RECORDING) close_loop(self);
+			break;
+		case LOOPER_PLAY:
+			if(self->mode == LOOPER_RECORDING) close_loop(self);
+			else if(self->mode != LOOPER_EMPTY) self->mode = LOOPER_PLAYING;
+			break;
+		case LOOPER_OVERDUB:
+		case LOOPER_MULTIPLY:
+			if(self->mode == LOOPER_RECORDING && !close_loop(self)) break;
+			if(self->mode == LOOPER_EMPTY) break;
+			if(start_layer(self, cmd == LOOPER_MULTIPLY))
+				self->mode = cmd == LOOPER_MULTIPLY ? LOOPER_MULTIPLYING : LOOPER_OVERDUBBING;
+			break;
+		case LOOPER_STOP:
+			if(self->mode == LOOPER_RECORDING && !close_loop(self)) break;
+			if(self->mode != LOOPER_EMPTY && self->mode != LOOPER_STOPPED) self->pending = LOOPER_STOP;
+			break;
+		case LOOPER_UNDO:
+		case LOOPER_CLEAR:
+			if(self->mode != LOOPER_EMPTY) self->pending = cmd;
+			break;
+	}
+}
+
+// STOP, UNDO and CLEAR cut the loop off, so they wait until it has faded out over a period.
+// If there's no room to tell the I/O thread, try again next period.
+static void finish_pending(looper_t * self)
+{
+	bool done = true;
+	switch(self->pending)
+	{
+		case LOOPER_STOP:
+			release(self);
+			self->mode = LOOPER_STOPPED;
+			self->k = self->r = 0;
+			atomic_store_explicit(&self->pub_pos, 0, memory_order_relaxed);
+			break;
+		case LOOPER_UNDO:
+			done = undo(self);
+			break;
+		case LOOPER_CLEAR:
+			done = clear(self);
+			break;
+	}
+	if(done) self->pending = LOOPER_NONE;
+}
+
+// the end of a cycle: go on to the next one, add another (multiplying), or go back to the top
+static void next_cycle(looper_t * self)
+{
+	self->r = 0;
+	if(self->k + 1 < self->cycles)
+		self->k++;
+	else if(self->mode == LOOPER_MULTIPLYING && (self->cycles + 1) * self->nc0 <= self->max_chunks)
+	{
+		self->k = self->cycles++;
+		self->kstack[self->depth] = self->cycles;
+	}
+	else
+	{
+		self->k = 0;
+		self->fresh_from = self->cycles;
+	}
+}
+
+void looper_apply_block(looper_t * self, float * buf, int n)
+{
+	int cmd = atomic_exchange_explicit(&self->cmd, LOOPER_NONE, memory_order_acquire);
+	if(cmd != LOOPER_NONE) command(self, cmd);
+	
+	if(self->mode != LOOPER_EMPTY && self->mode != LOOPER_STOPPED)
+	{
+		float g = self->fade;
+		float step = self->pending ? -g / n : 1.0f / LOOPER_FADE;
+		float level = self->level;
+		float fb = self->feedback;
+		
+		// a segment at a time, each within one chunk
+		int i = 0;
+		while(i < n)
+		{
+			unsigned int o = self->r % LOOPER_CHUNK;
+			unsigned int end = self->mode == LOOPER_RECORDING ? self->max_chunks * LOOPER_CHUNK : self->len0;
+			int m = n - i;
+			if(m > (int) (LOOPER_CHUNK - o)) m = LOOPER_CHUNK - o;
+			if(m > (int) (end - self->r)) m = end - self->r;
+			
+			float * x = buf + i;
+			struct looper_slot * sl = acquire(self, self->k * self->nc0 + self->r / LOOPER_CHUNK);
+			if(!sl)
+			{
+				// not there in time: the loop is silent here (and whatever was played isn't recorded)
+				atomic_fetch_add_explicit(&self->underruns, 1, memory_order_relaxed);
+				g = 0;
+			}
+			else
+			{
+				float * d = sl->data + o;
+				switch(self->mode)
+				{
+					case LOOPER_RECORDING:
+						touch(self, sl);
+						memcpy(d, x, m * sizeof(float));
+						break;
+					case LOOPER_OVERDUBBING:
+					case LOOPER_MULTIPLYING:
+						touch(self, sl);
+						for(int t = 0; t < m; t++)
+						{
+							float s = d[t];
+							d[t] = denormal_flush(s * fb + x[t]);
+							g = fminf(fmaxf(g + step, 0.0f), 1.0f);
+							x[t] += level * g * s;
+						}
+						break;
+					default:
+						// a cycle just added by multiply: every chunk of it gets stored, even where nothing was played over it
+						if(self->k >= self->fresh_from) touch(self, sl);
+						for(int t = 0; t < m; t++)
+						{
+							g = fminf(fmaxf(g + step, 0.0f), 1.0f);
+							x[t] += level * g * d[t];
+						}
+						break;
+				}
+			}
+			
+			i += m;
+			self->r += m;
+			if(self->r == end)
+			{
+				if(self->mode == LOOPER_RECORDING) close_loop(self); // out of room
+				else next_cycle(self);
+			}
+		}
+		self->fade = g;
+		if(self->pending) finish_pending(self);
+	}
+	else if(self->pending) finish_pending(self);
+	
+	atomic_store_explicit(&self->pub_n, self->mode == LOOPER_RECORDING ? 0 : self->cycles * self->nc0, memory_order_relaxed);
+	atomic_store_explicit(&self->pub_nc0, self->nc0, memory_order_relaxed);
+	atomic_store_explicit(&self->pub_mode, self->mode, memory_order_release);
+}
+
+
+// --- I/O thread ----------------------------
+
+static inline float * block(looper_t * self, uint32_t b)
+{
+	return self->file + (size_t) b * LOOPER_CHUNK;
+}
+
+static void free_layer(looper_t * self, int l)
+{
+	for(unsigned int c = 0; c < self->max_chunks; c++)
+	{
+		if(self->map[l][c] == LOOPER_NOBLOCK) continue;
+		self->free_blocks[self->nfree++] = self->map[l][c];
+		self->map[l][c] = LOOPER_NOBLOCK;
+	}
+}
+
+// fold layer 1 into layer 0, to make room for another
+static void merge(looper_t * self)
+{
+	uint32_t * m0 = self->map[0];
+	uint32_t * m1 = self->map[1];
+	for(unsigned int c = 0; c < self->max_chunks; c++)
+	{
+		if(m1[c] == LOOPER_NOBLOCK) continue;
+		if(m0[c] != LOOPER_NOBLOCK) self->free_blocks[self->nfree++] = m0[c];
+		m0[c] = m1[c];
+		m1[c] = LOOPER_NOBLOCK;
+	}
+	self->ids[0] = self->ids[1];
+	self->mult[0] = false;
+	for(int l = 1; l < self->top; l++)
+	{
+		self->map[l] = self->map[l + 1];
+		self->ids[l] = self->ids[l + 1];
+		self->mult[l] = self->mult[l + 1];
+	}
+	self->map[self->top] = m1;
+	self->top--;
+}
+
+// stack position of a layer, -1 if it hasn't been announced yet, -2 if it has been undone
+static int layer_index(looper_t * self, unsigned int id)
+{
+	if(id > self->ids[self->top]) return -1;
+	for(int l = self->top; l >= 0; l--)
+		if(self->ids[l] == id) return l;
+	return id < self->ids[0] ? 0 : -2;
+}
+
+static void store(looper_t * self, int l, unsigned int chunk, const float * data)
+{
+	uint32_t * b = &self->map[l][chunk];
+	if(*b == LOOPER_NOBLOCK)
+	{
+		if(!self->nfree)
+		{
+			atomic_fetch_add_explicit(&self->dropped, 1, memory_order_relaxed);
+			return;
+		}
+		*b = self->free_blocks[--self->nfree];
+	}
+	memcpy(block(self, *b), data, LOOPER_CHUNK * sizeof(float));
+}
+
+// the contents of a chunk, as of layer top
+static void fetch(looper_t * self, int top, unsigned int chunk, float * out)
+{
+	for(int l = top; l >= 0; l--)
+	{
+		if(self->map[l][chunk] == LOOPER_NOBLOCK) continue;
+		memcpy(out, block(self, self->map[l][chunk]), LOOPER_CHUNK * sizeof(float));
+		return;
+	}
+	memset(out, 0, LOOPER_CHUNK * sizeof(float));
+}
+
+static void drain(looper_t * self)
+{
+	unsigned int head = atomic_load_explicit(&self->ev_head, memory_order_acquire);
+	unsigned int tail = atomic_load_explicit(&self->ev_tail, memory_order_relaxed);
+	for(; tail != head; tail++)
+	{
+		const struct looper_event * e = &self->events[tail & (LOOPER_EVENTS - 1)];
+		int l;
+		switch(e->type)
+		{
+			case EV_CLEAR:
+				for(l = 0; l <= self->top; l++)
+				{
+					free_layer(self, l);
+					self->mult[l] = false;
+				}
+				self->top = 0;
+				for(int s = 0; s < LOOPER_SLOTS; s++)
+					self->slots[s].dirty = self->slots[s].stale = self->slots[s].inherited = false;
+				self->io_epoch = e->arg;
+				break;
+			case EV_RECORD:
+				self->ids[0] = e->layer;
+				break;
+			case EV_LAYER:
+				if(self->top == LOOPER_UNDO_LEVELS) merge(self);
+				self->top++;
+				self->ids[self->top] = e->layer;
+				self->mult[self->top] = e->arg;
+				break;
+			case EV_UNDO:
+				// anything in the window that came from the top layer has to be read again
+				l = self->top;
+				for(int s = 0; s < LOOPER_SLOTS; s++)
+				{
+					struct looper_slot * sl = &self->slots[s];
+					if(sl->dirty && sl->layer == self->ids[l])
+					{
+						sl->dirty = false;
+						sl->stale = true;
+					}
+					if(sl->inherited || (sl->chunk != NO_CHUNK && self->map[l][sl->chunk] != LOOPER_NOBLOCK))
+						sl->stale = true;
+				}
+				if(l > 0)
+				{
+					free_layer(self, l);
+					self->mult[l] = false;
+					self->top--;
+				}
+				self->io_epoch = e->arg;
+				break;
+			case EV_SNAPSHOT:
+				l = layer_index(self, e->layer);
+				if(l >= 0) store(self, l, e->chunk, self->snap[e->arg]);
+				atomic_store_explicit(&self->snap_busy[e->arg], false, memory_order_release);
+				break;
+		}
+	}
+	atomic_store_explicit(&self->ev_tail, tail, memory_order_release);
+}
+
+// write out a slot the audio thread has changed (via the staging buffer, so that it isn't held up if the file is slow)
+static void flush(looper_t * self, struct looper_slot * sl)
+{
+	unsigned int expect = SLOT_READY;
+	if(!atomic_compare_exchange_strong_explicit(&sl->state, &expect, SLOT_IO, memory_order_acquire, memory_order_relaxed))
+		return;
+	int l = sl->dirty ? layer_index(self, sl->layer) : -1;
+	unsigned int chunk = sl->chunk;
+	if(l >= 0) memcpy(self->staging, sl->data, LOOPER_CHUNK * sizeof(float));
+	if(l != -1) sl->dirty = false;
+	atomic_store_explicit(&sl->state, SLOT_READY, memory_order_release);
+	if(l >= 0) store(self, l, chunk, self->staging);
+}
+
+// which chunk slot s should hold next: the first one that shares it at or after the play position, 
+// or failing that the first one after the loop wraps around.
+static unsigned int desired(unsigned int s, unsigned int pos, unsigned int limit, unsigned int n)
+{
+	if(s < LOOPER_HEAD) return s < limit ? s : NO_CHUNK;
+	unsigned int c = s;
+	if(pos > c) c += (pos - c + LOOPER_RING - 1) / LOOPER_RING * LOOPER_RING;
+	if(c < limit) return c;
+	return s < n ? s : NO_CHUNK;
+}
+
+// a multiply copies the first cycle as it was before the multiply began
+static int below_multiply(looper_t * self)
+{
+	for(int l = self->top; l > 0; l--)
+		if(self->mult[l]) return l - 1;
+	return self->top;
+}
+
+static bool stored(looper_t * self, unsigned int chunk)
+{
+	for(int l = self->top; l >= 0; l--)
+		if(self->map[l][chunk] != LOOPER_NOBLOCK) return true;
+	return false;
+}
+
+// Whether chunk j of the first cycle is settled enough to copy for a multiply: not while the audio thread is 
+// in it, nor while it has changes that haven't been written out. Once it's clear of both, any snapshot the 
+// audio thread took of it has been posted, so collect those.
+static bool source_ready(looper_t * self, unsigned int j)
+{
+	struct looper_slot * sl = &self->slots[slot_of(j)];
+	unsigned int expect = SLOT_READY;
+	if(!atomic_compare_exchange_strong_explicit(&sl->state, &expect, SLOT_IO, memory_order_acquire, memory_order_relaxed))
+		return false;
+	bool ready = sl->chunk != j || !sl->dirty;
+	atomic_store_explicit(&sl->state, SLOT_READY, memory_order_release);
+	if(ready) drain(self);
+	return ready;
+}
+
+// bring each slot round to the chunk it should hold next
+static void refill(looper_t * self)
+{
+	int mode = atomic_load_explicit(&self->pub_mode, memory_order_acquire);
+	unsigned int pos = atomic_load_explicit(&self->pub_pos, memory_order_relaxed);
+	unsigned int n = atomic_load_explicit(&self->pub_n, memory_order_relaxed);
+	unsigned int nc0 = atomic_load_explicit(&self->pub_nc0, memory_order_relaxed);
+	
+	// while recording, the chunks ahead are new (silent). When multiplying, the next cycle may be added.
+	bool fresh = mode == LOOPER_EMPTY || mode == LOOPER_RECORDING;
+	unsigned int limit = fresh ? self->max_chunks : n;
+	if(mode == LOOPER_MULTIPLYING && n + nc0 <= self->max_chunks) limit = n + nc0;
+	
+	for(int s = 0; s < LOOPER_SLOTS; s++)
+	{
+		struct looper_slot * sl = &self->slots[s];
+		unsigned int want = desired(s, pos, limit, n);
+		if(sl->chunk == want && sl->epoch == self->io_epoch && !sl->stale) continue;
+		
+		// chunks after the first cycle that haven't been stored yet are a copy of the first cycle
+		bool inherit = !fresh && want != NO_CHUNK && want >= nc0 && !stored(self, want);
+		if(inherit && !source_ready(self, want % nc0)) continue;
+		
+		unsigned int expect = SLOT_READY;
+		if(!atomic_compare_exchange_strong_explicit(&sl->state, &expect, SLOT_IO, memory_order_acquire, memory_order_relaxed))
+			continue;
+		if(sl->dirty)
+		{
+			int l = layer_index(self, sl->layer);
+			if(l == -1)
+			{
+				atomic_store_explicit(&sl->state, SLOT_READY, memory_order_release);
+				continue;
+			}
+			if(l >= 0) store(self, l, sl->chunk, sl->data);
+			sl->dirty = false;
+		}
+		if(want == NO_CHUNK) ;
+		else if(fresh) memset(sl->data, 0, LOOPER_CHUNK * sizeof(float));
+		else if(inherit) fetch(self, below_multiply(self), want % nc0, sl->data);
+		else fetch(self, self->top, want, sl->data);
+		sl->chunk = want;
+		sl->epoch = self->io_epoch;
+		sl->stale = false;
+		sl->inherited = inherit;
+		atomic_store_explicit(&sl->state, SLOT_READY, memory_order_release);
+	}
+}
+
+static void * io_thread(void * arg)
+{
+	looper_t * self = arg;
+	while(!atomic_load(&self->stop))
+	{
+		drain(self);
+		for(int s = 0; s < LOOPER_SLOTS; s++)
+			flush(self, &self->slots[s]);
+		refill(self);
+		usleep(LOOPER_IO_POLL_US);
+	}
+	return NULL;
+}
+
+
+// --- Setup ----------------------------
+
+static void free_all(looper_t * self)
+{
+	if(self->file) munmap(self->file, self->file_size);
+	for(int l = 0; l <= LOOPER_UNDO_LEVELS; l++)
+		free(self->map[l]);
+	free(self->free_blocks);
+	free(self->events);
+	free(self->slots[0].data);
+}
+
+int looper_construct(looper_t * self, unsigned int samplerate, float max_seconds, const char * filename)
+{
+	memset(self, 0, sizeof(looper_t));
+	
+	double max_chunks = ceil(max_seconds * samplerate / LOOPER_CHUNK);
+	double file_size = max_chunks * (LOOPER_UNDO_LEVELS + 1) * LOOPER_CHUNK * sizeof(float); // enough for every layer to change every chunk
+	if(max_seconds <= 0 || file_size > (double) (SIZE_MAX / 2))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	self->max_chunks = max_chunks;
+	self->nblocks = self->max_chunks * (LOOPER_UNDO_LEVELS + 1);
+	self->file_size = file_size;
+	self->min_len = LOOPER_MIN_MS / 1000.0 * samplerate;
+	self->level = 1;
+	self->feedback = 1;
+	self->held = -1;
+	self->next_layer = 1;
+	
+	// the window, the snapshots and the staging buffer (everything the audio thread touches is locked in memory)
+	size_t ram_size = (LOOPER_SLOTS + LOOPER_SNAPSHOTS + 1) * LOOPER_CHUNK * sizeof(float);
+	float * ram = calloc(1, ram_size);
+	self->events = calloc(LOOPER_EVENTS, sizeof(struct looper_event));
+	self->free_blocks = malloc(self->nblocks * sizeof(uint32_t));
+	bool ok = ram && self->events && self->free_blocks;
+	for(int l = 0; l <= LOOPER_UNDO_LEVELS; l++)
+	{
+		self->map[l] = malloc(self->max_chunks * sizeof(uint32_t));
+		if(self->map[l]) memset(self->map[l], 0xff, self->max_chunks * sizeof(uint32_t));
+		else ok = false;
+	}
+	for(int s = 0; s < LOOPER_SLOTS; s++)
+	{
+		struct looper_slot * sl = &self->slots[s];
+		sl->data = ram + s * LOOPER_CHUNK;
+		sl->chunk = s; // (ready to record)
+		atomic_init(&sl->state, SLOT_READY);
+	}
+	if(!ok)
+	{
+		free_all(self);
+		errno = ENOMEM;
+		return -1;
+	}
+	mlock(ram, ram_size);
+	mlock(self->events, LOOPER_EVENTS * sizeof(struct looper_event));
+	for(int i = 0; i < LOOPER_SNAPSHOTS; i++)
+	{
+		self->snap[i] = ram + (LOOPER_SLOTS + i) * LOOPER_CHUNK;
+		atomic_init(&self->snap_busy[i], false);
+	}
+	self->staging = ram + (LOOPER_SLOTS + LOOPER_SNAPSHOTS) * LOOPER_CHUNK;
+	
+	// blocks are handed out from the start of the file
+	for(unsigned int b = 0; b < self->nblocks; b++)
+		self->free_blocks[b] = self->nblocks - 1 - b;
+	self->nfree = self->nblocks;
+	
+	// The file is sparse, so only the blocks that get used take up any space. 
+	// Nothing needs it once it's mapped, so it goes away when we exit.
+	int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if(fd == -1)
+	{
+		free_all(self);
+		return -1;
+	}
+	void * p = MAP_FAILED;
+	if(0 == ftruncate(fd, self->file_size))
+		p = mmap(NULL, self->file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	unlink(filename);
+	if(p == MAP_FAILED)
+	{
+		free_all(self);
+		errno = err;
+		return -1;
+	}
+	self->file = p;
+	
+	atomic_init(&self->cmd, LOOPER_NONE);
+	atomic_init(&self->ev_head, 0);
+	atomic_init(&self->ev_tail, 0);
+	atomic_init(&self->pub_mode, LOOPER_EMPTY);
+	atomic_init(&self->pub_pos, 0);
+	atomic_init(&self->pub_n, 0);
+	atomic_init(&self->pub_nc0, 0);
+	atomic_init(&self->underruns, 0);
+	atomic_init(&self->dropped, 0);
+	atomic_init(&self->stop, false);
+	
+	if(0 != (errno = pthread_create(&self->tid, NULL, io_thread, self)))
+	{
+		free_all(self);
+		return -1;
+	}
+	return 0;
+}
+
+void looper_destruct(looper_t * self)
+{
+	atomic_store(&self->stop, true);
+	pthread_join(self->tid, NULL);
+	free_all(self);
+}
@@ -0,0 +1,179 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef LOOPER_H
+#define LOOPER_H
+
+// This file and the associated .c contain a looper: record a loop, then play it back, overdub onto it, 
+// multiply it (keep recording past the end, so the loop becomes a whole number of times longer) and undo 
+// the last few overdubs.
+//
+// Loops can be many minutes long. The loop is divided into chunks of LOOPER_CHUNK samples, and only a fixed
+// window of them is kept in RAM: the first LOOPER_HEAD chunks (so that there is always something to play 
+// while the rest of the loop comes back from disk after a wrap), plus LOOPER_RING chunks around the play 
+// position. A background I/O thread writes chunks that have changed out to a memory mapped file, and reads 
+// the chunks that will be needed next back in. The audio thread only ever touches the chunks in RAM, and never 
+// waits: if a chunk isn't there in time, the loop is silent for that stretch (and looper_underruns counts it).
+//
+// The file is a pool of chunk sized blocks. Each overdub (and each multiply) is a layer, which records which 
+// blocks hold the chunks it changed, so undo is just forgetting the top layer's blocks.
+// Memory use is bounded by the window and the layer tables, not by the loop length: the file's pages 
+// are page cache, which the kernel writes back and reclaims as needed.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define LOOPER_CHUNK 8192 // samples
+#define LOOPER_HEAD 8 // chunks at the start of the loop that are always in RAM
+#define LOOPER_RING 32 // chunks kept in RAM around the play position
+#define LOOPER_SLOTS (LOOPER_HEAD + LOOPER_RING)
+#define LOOPER_UNDO_LEVELS 4 // undo levels
+#define LOOPER_SNAPSHOTS 4
+#define LOOPER_EVENTS 64 // power of two
+#define LOOPER_FADE 64 // samples, for the loop fading in and out
+#define LOOPER_MIN_MS 100 // shorter recordings are discarded
+#define LOOPER_IO_POLL_US 2000
+#define LOOPER_NOBLOCK 0xffffffffu
+
+// commands (looper_command)
+enum looper_cmd
+{
+	LOOPER_NONE,
+	LOOPER_RECORD, // start recording (when empty), or stop recording and play
+	LOOPER_PLAY, // stop recording, overdubbing or multiplying, and play. Also restarts a stopped loop.
+	LOOPER_OVERDUB,
+	LOOPER_MULTIPLY,
+	LOOPER_STOP, // silence the loop (playing again starts from the top)
+	LOOPER_UNDO, // drop the last overdub or multiply (or the recording in progress)
+	LOOPER_CLEAR,
+};
+
+// states (looper_state)
+enum looper_mode
+{
+	LOOPER_EMPTY,
+	LOOPER_RECORDING,
+	LOOPER_PLAYING,
+	LOOPER_OVERDUBBING,
+	LOOPER_MULTIPLYING,
+	LOOPER_STOPPED,
+};
+
+struct looper_slot
+{
+	float * data; // LOOPER_CHUNK samples
+	atomic_uint state; // who may touch the slot (see looper.c)
+	unsigned int chunk; // which chunk of the loop data holds. Only the I/O thread changes this, or epoch.
+	unsigned int epoch;
+	unsigned int layer; // the layer that last changed data...
+	bool dirty; // ...if it hasn't been written to the file since
+	bool stale; // (I/O thread) data must be read again, after an undo
+	bool inherited; // (I/O thread) data was copied from the first cycle, for a multiply
+};
+
+struct looper_event
+{
+	uint32_t type;
+	uint32_t layer;
+	uint32_t chunk;
+	uint32_t arg;
+};
+
+typedef struct looper
+{
+	// audio thread
+	int mode;
+	int pending; // LOOPER_STOP, _UNDO or _CLEAR, which take effect at the end of the period, after the loop fades out
+	unsigned int epoch; // bumped when the contents of the window become invalid (undo, clear)
+	unsigned int layer; // id of the layer that recording or overdubbing goes into
+	unsigned int next_layer;
+	int depth; // number of layers that can be undone
+	unsigned int kstack[LOOPER_UNDO_LEVELS + 1]; // length of the loop in cycles, at each layer
+	unsigned int lstack[LOOPER_UNDO_LEVELS + 1]; // and the layer's id
+	unsigned int len0; // length of a cycle (the original recording), samples
+	unsigned int nc0; // chunks per cycle
+	unsigned int cycles; // the loop is this many cycles long (more than one after a multiply)
+	unsigned int fresh_from; // cycles from here on were added by multiply, and haven't been stored yet
+	unsigned int k, r; // play position: cycle, and sample within the cycle
+	int held; // the slot the audio thread is in, or -1
+	float fade;
+	unsigned int max_chunks;
+	unsigned int min_len;
+	
+	float level; // playback level of the loop
+	float feedback; // how much of the loop is kept under an overdub (1 = all of it)
+	
+	// control thread -> audio thread
+	atomic_int cmd;
+	
+	// audio thread -> I/O thread
+	struct looper_slot slots[LOOPER_SLOTS];
+	struct looper_event * events;
+	_Alignas(64) atomic_uint ev_head;
+	_Alignas(64) atomic_uint ev_tail;
+	float * snap[LOOPER_SNAPSHOTS]; // copies of chunks that a new layer is about to change, for undo
+	atomic_bool snap_busy[LOOPER_SNAPSHOTS];
+	atomic_uint pub_mode, pub_pos, pub_n, pub_nc0; // what the I/O thread needs to know which chunks come next
+	atomic_uint underruns;
+	atomic_uint dropped; // changes that couldn't be kept for undo (out of events, snapshots or file space)
+	atomic_bool stop;
+	
+	// I/O thread
+	float * file;
+	size_t file_size;
+	unsigned int nblocks;
+	uint32_t * map[LOOPER_UNDO_LEVELS + 1]; // per layer (0 = the recording), block holding each chunk, or LOOPER_NOBLOCK
+	unsigned int ids[LOOPER_UNDO_LEVELS + 1];
+	bool mult[LOOPER_UNDO_LEVELS + 1]; // layer is a multiply
+	int top;
+	uint32_t * free_blocks;
+	unsigned int nfree;
+	unsigned int io_epoch;
+	float * staging;
+	pthread_t tid;
+} looper_t;
+
+// max_seconds: longest loop. filename: scratch file for the loop (it is unlinked straight away; 
+// it should be on a real disk rather than a tmpfs, or it would count against memory after all).
+// Starts the I/O thread. returns 0 if ok, -1 and sets errno on an error.
+int looper_construct(looper_t * self, unsigned int samplerate, float max_seconds, const char * filename);
+
+void looper_destruct(looper_t * self);
+
+// from any thread. Takes effect at the start of the next period (a second command issued before then replaces the first).
+static inline void looper_command(looper_t * self, enum looper_cmd cmd)
+{
+	atomic_store_explicit(&self->cmd, cmd, memory_order_release);
+}
+
+static inline enum looper_mode looper_state(looper_t * self)
+{
+	return atomic_load_explicit(&self->pub_mode, memory_order_relaxed);
+}
+
+static inline unsigned int looper_underruns(looper_t * self)
+{
+	return atomic_load_explicit(&self->underruns, memory_order_relaxed);
+}
+
+// in place, mono: the loop is mixed into buf, and buf is what gets recorded.
+void looper_apply_block(looper_t * self, float * buf, int n);
+
+#endif
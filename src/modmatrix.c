@@ -0,0 +1,175 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "modmatrix.h"
+#include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+
+int modmatrix_construct(modmatrix_t * self, unsigned int samplerate, int ctrl, int ramp)
+{
+	if(ctrl < 1 || ctrl > MOD_CTRL_MAX || (ramp != MOD_RAMP_LINEAR && ramp != MOD_RAMP_SMOOTH))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	self->bufs = malloc(MOD_MAX_DESTS * MOD_BLOCK_MAX * sizeof(float));
+	if(!self->bufs) return -1;
+	// (the LFOs take one step per control period, so they're made ctrl times faster)
+	if(-1 == lfo_bank_construct(&self->lfos, samplerate))
+	{
+		free(self->bufs);
+		return -1;
+	}
+	
+	self->ndests = 0;
+	self->nroutes = 0;
+	self->ctrl = ctrl;
+	self->pos = 0;
+	for(int i = 0; i < ctrl; i++)
+	{
+		float t = (float) (i + 1) / ctrl;
+		self->ramp[i] = ramp == MOD_RAMP_SMOOTH ? t * t * (3 - 2 * t) : t;
+	}
+	
+	self->env = 0;
+	self->peak = 0;
+	self->attack = 1 - expf(-1000.0f * ctrl / (MOD_ENV_ATTACK_MS * samplerate));
+	self->release = 1 - expf(-1000.0f * ctrl / (MOD_ENV_RELEASE_MS * samplerate));
+	atomic_init(&self->pedal, 0.0f);
+	self->pedal_smooth = 0;
+	self->pedal_coef = 1 - expf(-1000.0f * ctrl / (MOD_PEDAL_MS * samplerate));
+	return 0;
+}
+
+void modmatrix_destruct(modmatrix_t * self)
+{
+	lfo_bank_destruct(&self->lfos);
+	free(self->bufs);
+}
+
+int modmatrix_add_lfo(modmatrix_t * self, int shape, float freq_hz, float phase)
+{
+	return lfo_bank_add(&self->lfos, shape, freq_hz * self->ctrl, phase);
+}
+
+int modmatrix_add_dest(modmatrix_t * self, float base, float min, float max)
+{
+	if(min > max || base < min || base > max)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(self->ndests == MOD_MAX_DESTS)
+	{
+		errno = ENOSPC;
+		return -1;
+	}
+	
+	int d = self->ndests++;
+	self->dests[d] = (struct mod_dest) {
+		.base = base, .min = min, .max = max, .prev = base, .next = base, 
+		.buf = self->bufs + d * MOD_BLOCK_MAX
+	};
+	return d;
+}
+
+const float * modmatrix_dest(const modmatrix_t * self, int dest)
+{
+	return self->dests[dest].buf;
+}
+
+int modmatrix_route(modmatrix_t * self, int src, int dest, float amount)
+{
+	if(src >= self->lfos.n || src < MOD_SRC_PEDAL || dest < 0 || dest >= self->ndests)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(self->nroutes == MOD_MAX_ROUTES)
+	{
+		errno = ENOSPC;
+		return -1;
+	}
+	self->routes[self->nroutes++] = (struct mod_route) {src, dest, amount};
+	return 0;
+}
+
+// a control point: step the sources, and work out where each destination goes next
+static void control_tick(modmatrix_t * self)
+{
+	float * out[LFO_BANK_MAX];
+	for(int k = 0; k < self->lfos.n; k++)
+		out[k] = &self->lfo_val[k];
+	lfo_bank_run(&self->lfos, out, 1);
+	
+	self->env += (self->peak > self->env ? self->attack : self->release) * (self->peak - self->env);
+	self->peak = 0;
+	float pedal = atomic_load_explicit(&self->pedal, memory_order_relaxed);
+	self->pedal_smooth += self->pedal_coef * (pedal - self->pedal_smooth);
+	
+	float v[MOD_MAX_DESTS];
+	for(int d = 0; d < self->ndests; d++)
+		v[d] = self->dests[d].base;
+	for(int r = 0; r < self->nroutes; r++)
+	{
+		const struct mod_route * route = &self->routes[r];
+		float s = route->src == MOD_SRC_ENVELOPE ? self->env 
+			: route->src == MOD_SRC_PEDAL ? self->pedal_smooth 
+			: self->lfo_val[route->src];
+		v[route->dest] += route->amount * s;
+	}
+	for(int d = 0; d < self->ndests; d++)
+	{
+		struct mod_dest * dest = &self->dests[d];
+		dest->prev = dest->next;
+		dest->next = v[d] < dest->min ? dest->min : v[d] > dest->max ? dest->max : v[d];
+	}
+}
+
+void modmatrix_run(modmatrix_t * self, const float * in, int n)
+{
+	for(int i = 0; i < n; )
+	{
+		if(self->pos == 0) 
+			control_tick(self);
+		int m = n - i < self->ctrl - self->pos ? n - i : self->ctrl - self->pos;
+		
+		if(in)
+		{
+			float peak = self->peak;
+			for(int j = 0; j < m; j++)
+				peak = fabsf(in[i + j]) > peak ? fabsf(in[i + j]) : peak;
+			self->peak = peak;
+		}
+		
+		const float * ramp = self->ramp + self->pos;
+		for(int d = 0; d < self->ndests; d++)
+		{
+			const struct mod_dest * dest = &self->dests[d];
+			float a = dest->prev, step = dest->next - dest->prev;
+			for(int j = 0; j < m; j++)
+				dest->buf[i + j] = a + step * ramp[j];
+		}
+		
+		i += m;
+		self->pos += m;
+		if(self->pos == self->ctrl) 
+			self->pos = 0;
+	}
+}
@@ -0,0 +1,116 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef MODMATRIX_H
+#define MODMATRIX_H
+
+// This file and the associated .c contain a modulation matrix: a few sources (LFOs, an envelope follower on 
+// the input, an expression pedal) routed, each with its own amount, to effect parameters (destinations).
+// The sources and routes are only evaluated at the control rate (every ctrl samples). In between, each 
+// destination ramps from its previous value to the new one, linearly or along an S curve, so it stays smooth.
+// The result is a buffer of per-sample values per destination, which is handed to an effect through 
+// its modulation port (e.g. tremolo_t's depth_mod): a pointer that the effect reads instead of the fixed parameter.
+
+#include "lfo.h"
+#include <stdatomic.h>
+
+#define MOD_MAX_SOURCES 8
+#define MOD_MAX_DESTS 8
+#define MOD_MAX_ROUTES 16
+#define MOD_BLOCK_MAX 256 // longest block modmatrix_run takes
+#define MOD_CTRL_MAX 256 // longest control period
+
+// sources (besides the LFOs, which are numbered from 0 in the order they're added)
+#define MOD_SRC_ENVELOPE (-1) // input level, 0 to about 1
+#define MOD_SRC_PEDAL (-2) // expression pedal, 0 (heel) to 1 (toe)
+
+// ramps between control points
+#define MOD_RAMP_LINEAR 0
+#define MOD_RAMP_SMOOTH 1 // smoothstep: no corners at the control points
+
+#define MOD_ENV_ATTACK_MS 5.0
+#define MOD_ENV_RELEASE_MS 150.0
+#define MOD_PEDAL_MS 20.0 // the pedal is smoothed with this time constant (the reading is coarse, and updated at any time)
+
+struct mod_route
+{
+	int src; // an LFO index, or MOD_SRC_
+	int dest;
+	float amount; // the destination moves by amount * source
+};
+
+struct mod_dest
+{
+	float base; // the value with no modulation
+	float min, max; // the result is clamped to this range
+	float prev, next; // values at the last and next control points
+	float * buf; // this block's values
+};
+
+typedef struct modmatrix
+{
+	lfo_bank_t lfos; // runs at the control rate
+	float lfo_val[LFO_BANK_MAX];
+	struct mod_dest dests[MOD_MAX_DESTS];
+	int ndests;
+	struct mod_route routes[MOD_MAX_ROUTES];
+	int nroutes;
+	
+	int ctrl; // control period, samples
+	int pos; // samples into the current control period
+	float ramp[MOD_CTRL_MAX]; // ramp[i]: how far along to the next control point, i+1 samples in
+	
+	float env; // envelope follower
+	float peak; // input peak over the current control period
+	float attack, release; // follower coefficients, per control period
+	_Atomic float pedal; // set by modmatrix_set_pedal
+	float pedal_smooth;
+	float pedal_coef;
+	
+	float * bufs; // storage for the destinations' buffers
+} modmatrix_t;
+
+// ctrl: control period in samples (1 to MOD_CTRL_MAX). ramp: MOD_RAMP_ constant.
+// returns 0 if ok, -1 and sets errno on an error (EINVAL for bad parameters).
+int modmatrix_construct(modmatrix_t * self, unsigned int samplerate, int ctrl, int ramp);
+
+void modmatrix_destruct(modmatrix_t * self);
+
+// add an LFO source (shape is an LFO_ constant from lfo.h, phase 0 to 1).
+// returns the source number, or -1 and sets errno.
+int modmatrix_add_lfo(modmatrix_t * self, int shape, float freq_hz, float phase);
+
+// add a destination: base value, and the range it's kept in.
+// returns the destination number, or -1 and sets errno.
+int modmatrix_add_dest(modmatrix_t * self, float base, float min, float max);
+
+// the buffer of a destination, to connect to an effect's modulation port. Valid after each modmatrix_run.
+const float * modmatrix_dest(const modmatrix_t * self, int dest);
+
+// route a source to a destination. returns 0 if ok, -1 and sets errno.
+int modmatrix_route(modmatrix_t * self, int src, int dest, float amount);
+
+// set the expression pedal (0 to 1). May be called from any thread, at any time.
+static inline void modmatrix_set_pedal(modmatrix_t * self, float value)
+{
+	atomic_store_explicit(&self->pedal, value, memory_order_relaxed);
+}
+
+// compute the destinations' next n values (n up to MOD_BLOCK_MAX). in: the signal for the envelope follower (or NULL).
+void modmatrix_run(modmatrix_t * self, const float * in, int n);
+
+#endif
@@ -0,0 +1,209 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "multitap.h"
+#include "denormal.h"
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
+
+// compute the tap delays at bpm (into D) and return the longest, or -1 if one would be longer than max_ms.
+// Only reads what's fixed at construction, so any thread can call it.
+static int tap_times(const multitap_t * self, float bpm, unsigned int * D)
+{
+	int longest = 0;
+	for(int t = 0; t < self->ntaps; t++)
+	{
+		const struct mt_tap * tap = &self->taps[t];
+		float ms = tap->beats > 0 ? tap->beats * 60000.0f / bpm : tap->ms;
+		float d = ms * self->samplerate / 1000.0f;
+		if(d < 1) d = 1;
+		if(d > self->max_d)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		D[t] = (unsigned int) d;
+		if(D[t] > D[longest]) longest = t;
+	}
+	return longest;
+}
+
+int multitap_construct(multitap_t * self, unsigned int samplerate, float max_ms, 
+						const struct mt_tap * taps, int ntaps, float bpm, float feedback, float mix)
+{
+	if(ntaps < 1 || ntaps > MT_MAX_TAPS || max_ms <= 0 || bpm <= 0 
+		|| feedback < 0 || feedback > 1 || mix < 0 || mix > 1)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	memcpy(self->taps, taps, ntaps * sizeof(struct mt_tap));
+	self->ntaps = ntaps;
+	self->samplerate = samplerate;
+	self->feedback = feedback;
+	self->mix = mix;
+	self->last_tap_ns = 0;
+	self->max_d = max_ms * samplerate / 1000.0f;
+	
+	// filters (taps without one, and unused lanes, pass the signal unchanged), and constant power panning
+	struct bq_filter f[MT_MAX_TAPS];
+	for(int t = 0; t < MT_MAX_TAPS; t++)
+	{
+		f[t] = (struct bq_filter) {.cx0 = 1};
+		if(t < ntaps)
+		{
+			if(taps[t].filter_type && -1 == make_biquad(&f[t], taps[t].filter_type, taps[t].filter_freq, samplerate, 0.707))
+				return -1;
+			float theta = (taps[t].pan + 1) * (float) M_PI / 4;
+			self->gl[t] = taps[t].gain * cosf(theta);
+			self->gr[t] = taps[t].gain * sinf(theta);
+		}
+	}
+	for(int b = 0; b < MT_MAX_TAPS / 4; b++)
+		make_biquad_bank(&self->filt[b], &f[4*b], 4);
+	
+	if(-1 == ring_construct(&self->ring, self->max_d + 1))
+		return -1;
+	if(-1 == (self->fb_tap = tap_times(self, bpm, self->D)))
+	{
+		ring_destruct(&self->ring);
+		return -1;
+	}
+	memcpy(self->D_old, self->D, sizeof(self->D));
+	self->fb_tap_old = self->fb_tap;
+	self->fade = MT_XFADE;
+	self->bpm = bpm;
+	atomic_init(&self->bpm_req, bpm);
+	return 0;
+}
+
+void multitap_destruct(multitap_t * self)
+{
+	ring_destruct(&self->ring);
+}
+
+int multitap_set_bpm(multitap_t * self, float bpm)
+{
+	unsigned int D[MT_MAX_TAPS];
+	if(bpm <= 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(-1 == tap_times(self, bpm, D))
+		return -1;
+	atomic_store_explicit(&self->bpm_req, bpm, memory_order_relaxed);
+	return 0;
+}
+
+void multitap_tap_tempo(multitap_t * self, uint64_t now_ns)
+{
+	uint64_t dt = now_ns - self->last_tap_ns;
+	self->last_tap_ns = now_ns;
+	if(dt >= 200000000ull && dt <= 2000000000ull)
+		multitap_set_bpm(self, 60e9 / dt); // (if a tap wouldn't fit at that tempo, the old tempo stays)
+}
+
+void multitap_apply_block(multitap_t * self, const float * in, float * outL, float * outR, int n)
+{
+	float taps[MT_MAX_TAPS][MT_BLOCK_MAX];
+	float line[MT_BLOCK_MAX];
+	float old[MT_BLOCK_MAX], g[MT_BLOCK_MAX], fbx[MT_BLOCK_MAX];
+	const int nbanks = (self->ntaps + 3) / 4;
+	
+	// Pick up a new tempo. Jumping the read heads would click on every tap, so they crossfade from the old times.
+	float bpm = atomic_load_explicit(&self->bpm_req, memory_order_relaxed);
+	if(bpm != self->bpm && self->fade >= MT_XFADE)
+	{
+		memcpy(self->D_old, self->D, sizeof(self->D));
+		self->fb_tap_old = self->fb_tap;
+		self->fb_tap = tap_times(self, bpm, self->D); // (multitap_set_bpm checked that it fits)
+		self->bpm = bpm;
+		self->fade = 0;
+	}
+	
+	// a chunk can't be longer than the shortest tap, or it would echo its own beginning
+	unsigned int chunk = MT_BLOCK_MAX;
+	for(int t = 0; t < self->ntaps; t++)
+	{
+		if(self->D[t] < chunk) chunk = self->D[t];
+		if(self->fade < MT_XFADE && self->D_old[t] < chunk) chunk = self->D_old[t];
+	}
+	
+	for(int i = 0; i < n; i += chunk)
+	{
+		int m = n - i < chunk ? n - i : chunk;
+		bool fading = self->fade < MT_XFADE;
+		
+		for(int t = 0; t < self->ntaps; t++)
+			ring_read(&self->ring, self->D[t], taps[t], m);
+		if(fading)
+		{
+			for(int j = 0; j < m; j++)
+			{
+				g[j] = (float) (self->fade + j) / MT_XFADE;
+				if(g[j] > 1) g[j] = 1;
+			}
+			for(int t = 0; t < self->ntaps; t++)
+			{
+				ring_read(&self->ring, self->D_old[t], old, m);
+				for(int j = 0; j < m; j++)
+					taps[t][j] = old[j] + g[j] * (taps[t][j] - old[j]);
+			}
+			self->fade += m;
+		}
+		for(int b = 0; b < nbanks; b++)
+		{
+			float * io[4];
+			for(int k = 0; k < 4; k++)
+				io[k] = 4*b + k < self->ntaps ? taps[4*b + k] : NULL;
+			apply_biquad_bank(&self->filt[b], (const float * const *) io, io, m);
+		}
+		
+		float * L = outL + i;
+		float * R = outR + i;
+		const float * x = in + i;
+		const float * fb = taps[self->fb_tap];
+		if(fading && self->fb_tap_old != self->fb_tap)
+		{
+			// the longest tap changed: crossfade the feedback from the old one too
+			const float * fbo = taps[self->fb_tap_old];
+			for(int j = 0; j < m; j++)
+				fbx[j] = fbo[j] + g[j] * (fb[j] - fbo[j]);
+			fb = fbx;
+		}
+		for(int j = 0; j < m; j++)
+		{
+			line[j] = denormal_flush(x[j] + self->feedback * fb[j]);
+			L[j] = x[j];
+			R[j] = x[j];
+		}
+		for(int t = 0; t < self->ntaps; t++)
+		{
+			const float gl = self->mix * self->gl[t], gr = self->mix * self->gr[t];
+			for(int j = 0; j < m; j++)
+			{
+				L[j] += gl * taps[t][j];
+				R[j] += gr * taps[t][j];
+			}
+		}
+		ring_write(&self->ring, line, m);
+	}
+}
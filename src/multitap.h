@@ -0,0 +1,86 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef MULTITAP_H
+#define MULTITAP_H
+
+// This file and the associated .c contain a multi-tap delay: up to MT_MAX_TAPS echoes read from one shared delay line, 
+// each with its own time, gain, stereo position and filter. Tap times can be fixed, or a number of beats at a tempo 
+// (which can be tapped in with multitap_tap_tempo).
+// The taps are read a block at a time and filtered four at a time (one biquad bank per four taps).
+
+#include "ring.h"
+#include "biquad_filt.h"
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define MT_MAX_TAPS 8
+#define MT_BLOCK_MAX 256 // processing chunk
+#define MT_XFADE 1024 // a tempo change crossfades every tap from its old time to its new one over this many samples
+
+struct mt_tap
+{
+	float ms; // delay time, used if beats is 0
+	float beats; // delay time in beats at the current tempo (e.g. 0.75 for a dotted eighth note), or 0
+	float gain; // 0 to 1
+	float pan; // -1 (left) to 1 (right)
+	int filter_type; // BQ_LOWPASS, BQ_HIGHPASS etc. or 0 for none
+	float filter_freq; // Hz
+};
+
+typedef struct multitap
+{
+	ring_t ring;
+	struct mt_tap taps[MT_MAX_TAPS];
+	int ntaps;
+	unsigned int D[MT_MAX_TAPS]; // tap delays in samples
+	unsigned int max_d; // longest a tap may be (max_ms), in samples. The ring is longer (a power of two).
+	float gl[MT_MAX_TAPS], gr[MT_MAX_TAPS]; // per channel gain of each tap
+	int fb_tap; // the longest tap, which is fed back into the line
+	unsigned int D_old[MT_MAX_TAPS]; // tap delays before the last tempo change, being faded out
+	int fb_tap_old;
+	int fade; // samples into the crossfade from D_old to D (MT_XFADE once it's done)
+	bq_bank_t filt[MT_MAX_TAPS / 4];
+	
+	float feedback; // 0 to 1
+	float mix; // 0 to 1
+	float bpm; // tempo of D
+	_Atomic float bpm_req; // tempo asked for by multitap_set_bpm, picked up by multitap_apply_block
+	unsigned int samplerate;
+	uint64_t last_tap_ns; // multitap_tap_tempo
+} multitap_t;
+
+// max_ms: longest delay time any tap will need. bpm: initial tempo for the synced taps.
+// returns 0 if ok, -1 and sets errno on an error (EINVAL for bad parameters).
+int multitap_construct(multitap_t * self, unsigned int samplerate, float max_ms, 
+						const struct mt_tap * taps, int ntaps, float bpm, float feedback, float mix);
+
+void multitap_destruct(multitap_t * self);
+
+// change the tempo of the synced taps. Safe to call from any thread: the new tempo is published atomically, and 
+// multitap_apply_block crossfades the taps to it (a change that arrives during a crossfade waits for it to finish).
+// returns 0 if ok, -1 and sets errno (EINVAL) if a tap would be longer than max_ms.
+int multitap_set_bpm(multitap_t * self, float bpm);
+
+// tap tempo: call on each tap (now_ns from CLOCK_MONOTONIC). Two taps between 0.2 and 2 seconds apart set the tempo.
+// Can be called from a control thread (e.g. the one watching the footswitch), but only from one.
+void multitap_tap_tempo(multitap_t * self, uint64_t now_ns);
+
+// mono in, stereo out (the dry signal goes to both sides). outL may be the same buffer as in.
+void multitap_apply_block(multitap_t * self, const float * in, float * outL, float * outR, int n);
+
+#endif
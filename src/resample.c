@@ -0,0 +1,177 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "resample.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <arm_neon.h>
+
+#define RS_CUTOFF 0.9 // filter cutoff, relative to nyquist
+
+// control loop constants. The fill level is measured in frames, once per period.
+#define DC_SETTLE_PERIODS 2000 // ~3 seconds at 64 frame periods. Lets the devices reach their steady state before locking the target.
+#define DC_RELOCK_PERIODS 500 // ~0.7 seconds. After an xrun only the fill level is re-measured; the ratio keeps following the learned drift.
+#define DC_FILL_ALPHA 0.01f // smoothing of the measured fill level (removes the sawtooth caused by period-sized reads and writes)
+#define DC_KP 1e-5 // proportional gain (ratio change per frame of error)
+#define DC_KI 1.6e-9 // integral gain. Together with DC_KP this gives a critically damped loop with a time constant of a few seconds.
+#define DC_MAX_DEV 0.002 // the ratio is clamped to 1 +/- this. Real crystals are within ~100 ppm of each other.
+
+int resampler_construct(resampler_t * self, unsigned int nch, unsigned int max_in)
+{
+	if(nch < 1 || nch > RS_MAX_CHANNELS)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	memset(self, 0, sizeof(resampler_t));
+	self->nch = nch;
+	self->max_in = max_in;
+	self->ratio = 1.0;
+	self->pos = 0.0;
+	
+	self->coefs = malloc(sizeof(float) * (RS_PHASES + 1) * RS_TAPS);
+	if(!self->coefs) return -1;
+	for(int c = 0; c < nch; c++)
+	{
+		self->hist[c] = calloc(RS_TAPS - 1 + max_in, sizeof(float));
+		if(!self->hist[c])
+		{
+			resampler_destruct(self);
+			return -1;
+		}
+	}
+	
+	// Windowed sinc, sampled at RS_PHASES+1 fractional offsets. Branch p interpolates the signal at 
+	// a point p/RS_PHASES of the way between history samples RS_TAPS/2-1 and RS_TAPS/2.
+	for(int p = 0; p <= RS_PHASES; p++)
+	{
+		float * h = self->coefs + p * RS_TAPS;
+		double sum = 0;
+		for(int k = 0; k < RS_TAPS; k++)
+		{
+			double x = k - (RS_TAPS/2 - 1) - (double) p / RS_PHASES;
+			double s = (x == 0.0) ? RS_CUTOFF : sin(M_PI * RS_CUTOFF * x) / (M_PI * x);
+			double w = 0.42 + 0.5 * cos(M_PI * x / (RS_TAPS/2)) + 0.08 * cos(2 * M_PI * x / (RS_TAPS/2)); // blackman
+			h[k] = s * w;
+			sum += h[k];
+		}
+		for(int k = 0; k < RS_TAPS; k++)
+			h[k] /= sum; // unity gain at DC for every branch
+	}
+	
+	return 0;
+}
+
+void resampler_destruct(resampler_t * self)
+{
+	free(self->coefs);
+	for(int c = 0; c < RS_MAX_CHANNELS; c++)
+		free(self->hist[c]);
+}
+
+int resampler_process(resampler_t * self, const float * const * in, int n, float * const * out)
+{
+	for(int c = 0; c < self->nch; c++)
+		memcpy(self->hist[c] + RS_TAPS - 1, in[c], n * sizeof(float));
+	
+	const int len = RS_TAPS - 1 + n;
+	double t = self->pos;
+	int nout = 0;
+	
+	while((int) t + RS_TAPS <= len)
+	{
+		int i = (int) t;
+		float fp = (t - i) * RS_PHASES;
+		int p = (int) fp;
+		float32x4_t a = vdupq_n_f32(fp - p);
+		const float * c0 = self->coefs + p * RS_TAPS;
+		const float * c1 = c0 + RS_TAPS;
+		
+		for(int c = 0; c < self->nch; c++)
+		{
+			const float * x = self->hist[c] + i;
+			float32x4_t acc = vmovq_n_f32(0.0f);
+			for(int k = 0; k < RS_TAPS; k += 4)
+			{
+				// interpolate between adjacent branches, then multiply-accumulate against the input
+				float32x4_t h0 = vld1q_f32(c0 + k);
+				float32x4_t h = vfmaq_f32(h0, a, vsubq_f32(vld1q_f32(c1 + k), h0));
+				acc = vfmaq_f32(acc, h, vld1q_f32(x + k));
+			}
+			float32x2_t s = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+			out[c][nout] = vget_lane_f32(vpadd_f32(s, s), 0);
+		}
+		nout++;
+		t += self->ratio;
+	}
+	
+	self->pos = t - n;
+	for(int c = 0; c < self->nch; c++)
+		memmove(self->hist[c], self->hist[c] + n, (RS_TAPS - 1) * sizeof(float));
+	
+	return nout;
+}
+
+
+
+
+void drift_ctl_reset(drift_ctl_t * self)
+{
+	self->fill = 0;
+	self->target = 0;
+	self->integ = 0;
+	self->settle = DC_SETTLE_PERIODS;
+	self->fresh = true;
+}
+
+void drift_ctl_relock(drift_ctl_t * self)
+{
+	self->settle = DC_RELOCK_PERIODS;
+	self->fresh = true;
+}
+
+double drift_ctl_update(drift_ctl_t * self, float fill)
+{
+	if(self->settle > 0)
+	{
+		// Just observe while the devices start up (or recover). We hold whatever depth they settle at,
+		// which is the minimum that the configured period/buffer sizes allow. In the meantime the ratio stays 
+		// at the drift learned so far (none at startup), so that a recovery doesn't let the clocks wander off.
+		self->fill = self->fresh ? fill : self->fill + DC_FILL_ALPHA * (fill - self->fill);
+		self->fresh = false;
+		if(--self->settle == 0) self->target = self->fill;
+		return 1.0 + self->integ;
+	}
+	
+	self->fill += DC_FILL_ALPHA * (fill - self->fill);
+	
+	// Too much queued means we produce samples faster than the playback device consumes them,
+	// so consume more input per output sample (ratio > 1), and vice versa.
+	double err = self->fill - self->target;
+	self->integ += DC_KI * err;
+	if(self->integ > DC_MAX_DEV) self->integ = DC_MAX_DEV;
+	if(self->integ < -DC_MAX_DEV) self->integ = -DC_MAX_DEV;
+	
+	double dev = DC_KP * err + self->integ;
+	if(dev > DC_MAX_DEV) dev = DC_MAX_DEV;
+	if(dev < -DC_MAX_DEV) dev = -DC_MAX_DEV;
+	
+	return 1.0 + dev;
+}
@@ -0,0 +1,83 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+// This file and the associated .c contain a small polyphase resampler, and the control loop that drives it 
+// to compensate for clock drift between separate capture and playback devices.
+// 
+// When the input and output are different sound cards, their sample clocks are never exactly equal. 
+// Left alone, the playback buffer slowly fills up or drains until ALSA reports an xrun. Instead, we resample
+// the processed signal by a ratio very close to 1, and steer that ratio so that the amount of audio queued 
+// between the two devices stays constant.
+
+#include <stdbool.h>
+
+#define RS_TAPS 16 // FIR taps per polyphase branch. Must be divisible by 4 (SIMD). The resampler delays the signal by RS_TAPS/2 samples.
+#define RS_PHASES 64 // number of polyphase branches. Fractional positions between branches are linearly interpolated.
+#define RS_MAX_EXTRA 4 // output buffers must have room for (input count + RS_MAX_EXTRA) samples.
+#define RS_MAX_CHANNELS 2
+
+_Static_assert(RS_TAPS % 4 == 0, "RS_TAPS must be divisible by 4");
+
+typedef struct resampler
+{
+	float * coefs; // (RS_PHASES+1) x RS_TAPS table of filter coefficients
+	float * hist[RS_MAX_CHANNELS]; // per channel: the last RS_TAPS-1 input samples, followed by the incoming block
+	unsigned int nch;
+	unsigned int max_in; // largest block accepted by resampler_process
+	double pos; // read position into hist, in input samples
+	double ratio; // input samples consumed per output sample. 1.0 when the clocks agree. Set by the drift controller.
+} resampler_t;
+
+// returns 0 on success, -1 and sets errno on failure.
+// nch: number of (planar) channels processed in lockstep.
+// max_in: largest number of input samples that will be passed to resampler_process at once.
+int resampler_construct(resampler_t * self, unsigned int nch, unsigned int max_in);
+
+void resampler_destruct(resampler_t * self);
+
+// consume n input samples (per channel) and produce output at the current ratio. 
+// returns the number of output samples written (per channel), which is at most n + RS_MAX_EXTRA.
+int resampler_process(resampler_t * self, const float * const * in, int n, float * const * out);
+
+
+
+
+// Control loop that turns measurements of the device fill levels into a resampling ratio.
+typedef struct drift_ctl
+{
+	float fill; // low-pass filtered fill level (frames queued in capture + playback)
+	float target; // fill level we are trying to hold, locked in once the streams have settled
+	double integ; // integral term
+	unsigned int settle; // periods remaining before the target is locked in
+	bool fresh; // the next measurement restarts the fill level filter
+} drift_ctl_t;
+
+// start the control loop from scratch (at startup).
+void drift_ctl_reset(drift_ctl_t * self);
+
+// after an xrun: the fill levels jump, so re-measure them and lock a new target, but keep the drift 
+// learned so far (the clocks haven't changed), so that the loop doesn't have to converge again.
+void drift_ctl_relock(drift_ctl_t * self);
+
+// fill: total frames currently queued in the capture and playback devices (measured once per period).
+// returns the resampling ratio to use for the next period.
+double drift_ctl_update(drift_ctl_t * self, float fill);
+
+#endif
@@ -0,0 +1,101 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "ring.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+int ring_construct(ring_t * self, unsigned int min_size)
+{
+	if(min_size == 0 || min_size > (1u << 31))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	unsigned int size = 1;
+	while(size < min_size) size <<= 1;
+	
+	self->buf = calloc(size + RING_GUARD, sizeof(float));
+	if(!self->buf) return -1;
+	self->size = size;
+	self->mask = size - 1;
+	self->w = 0;
+	return 0;
+}
+
+void ring_destruct(ring_t * self)
+{
+	free(self->buf);
+}
+
+void ring_write(ring_t * self, const float * in, int n)
+{
+	unsigned int start = self->w & self->mask;
+	unsigned int first = self->size - start;
+	if(first > n) first = n;
+	memcpy(self->buf + start, in, first * sizeof(float));
+	memcpy(self->buf, in + first, (n - first) * sizeof(float));
+	memcpy(self->buf + self->size, self->buf, RING_GUARD * sizeof(float));
+	self->w += n;
+}
+
+void ring_read(const ring_t * self, unsigned int delay, float * out, int n)
+{
+	unsigned int start = (self->w - delay) & self->mask;
+	unsigned int first = self->size - start;
+	if(first > n) first = n;
+	memcpy(out, self->buf + start, first * sizeof(float));
+	memcpy(out + first, self->buf, (n - first) * sizeof(float));
+}
+
+void ring_read_frac(const ring_t * self, interp_t * ip, const float * delay, float * out, int n)
+{
+	int i = 0;
+	if(ip->type != INTERP_THIRAN) // (the allpass has state, so it goes a sample at a time)
+	{
+		for(; i + 4 <= n; i += 4)
+		{
+			// one vector of points per output sample, transposed so that r0..r3 each hold one point of all four samples
+			float u[4];
+			float32x4_t r0 = vld1q_f32(ring_points(self, delay[i] - i, &u[0]));
+			float32x4_t r1 = vld1q_f32(ring_points(self, delay[i+1] - (i+1), &u[1]));
+			float32x4_t r2 = vld1q_f32(ring_points(self, delay[i+2] - (i+2), &u[2]));
+			float32x4_t r3 = vld1q_f32(ring_points(self, delay[i+3] - (i+3), &u[3]));
+			transpose4(&r0, &r1, &r2, &r3);
+			float32x4_t uv = vld1q_f32(u);
+			
+			float32x4_t y;
+			if(ip->type == INTERP_LINEAR)
+				y = vfmaq_f32(r1, uv, vsubq_f32(r2, r1));
+			else if(ip->type == INTERP_HERMITE)
+				y = hermite_q(r0, r1, r2, r3, uv);
+			else
+				y = lagrange3_q(r0, r1, r2, r3, uv);
+			vst1q_f32(out + i, y);
+		}
+	}
+	
+	for(; i < n; i++)
+	{
+		float u;
+		const float * p = ring_points(self, delay[i] - i, &u);
+		out[i] = interp_read(ip, p, u);
+	}
+}
@@ -0,0 +1,82 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef RING_H
+#define RING_H
+
+// This file and the associated .c contain a circular buffer (delay line) whose size is a power of two, 
+// so that positions wrap with a mask instead of a modulo or a branch.
+// The write position counts up forever (unsigned wraparound is fine, since the size divides 2^32), 
+// and samples are addressed by how long ago they were written.
+// Block reads and writes touch at most two contiguous segments of the buffer.
+// The first RING_GUARD samples are mirrored after the end of the buffer, so that the few consecutive samples 
+// an interpolator needs can always be read without wrapping.
+
+#include "interp.h"
+
+#define RING_GUARD 4
+
+typedef struct ring
+{
+	float * buf; // size + RING_GUARD
+	unsigned int size; // power of two
+	unsigned int mask; // size - 1
+	unsigned int w; // the next sample written goes to buf[w & mask]
+} ring_t;
+
+// size is rounded up to a power of two. The ring starts out full of silence.
+// returns 0 if ok, -1 and sets errno on an error.
+int ring_construct(ring_t * self, unsigned int min_size);
+
+void ring_destruct(ring_t * self);
+
+// append n samples
+void ring_write(ring_t * self, const float * in, int n);
+
+// out[i] = the sample that was written delay samples before the (i)th sample of the next write.
+// i.e. reading n samples at delay D, then writing n samples, delays the signal by D. 
+// delay must be at least n (the samples must already have been written) and at most size.
+void ring_read(const ring_t * self, unsigned int delay, float * out, int n);
+
+// out[i] = the signal delay[i] (fractional) samples before the (i)th sample of the next write, interpolated.
+// All but the Thiran allpass are done four samples at a time.
+// delay[i] must be at least i + 3 (the interpolator looks up to two samples ahead), and at most size - 2.
+void ring_read_frac(const ring_t * self, interp_t * ip, const float * delay, float * out, int n);
+
+// a single sample, delay samples ago (1 is the latest sample written)
+static inline float ring_tap(const ring_t * self, unsigned int delay)
+{
+	return self->buf[(self->w - delay) & self->mask];
+}
+
+// the four consecutive samples around a fractional delay d, for the interpolators in interp.h, and the position u between them
+static inline const float * ring_points(const ring_t * self, float d, float * u)
+{
+	unsigned int di = (unsigned int) d;
+	*u = 1.0f - (d - di);
+	return self->buf + ((self->w - di - 2) & self->mask);
+}
+
+static inline void ring_push(ring_t * self, float x)
+{
+	unsigned int i = self->w & self->mask;
+	self->buf[i] = x;
+	if(i < RING_GUARD) self->buf[self->size + i] = x;
+	self->w++;
+}
+
+#endif
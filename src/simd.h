@@ -0,0 +1,66 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef SIMD_H
+#define SIMD_H
+
+// Small NEON helpers shared by several effects.
+
+#include <arm_neon.h>
+
+// transpose a 4x4 matrix held in four row vectors, in place
+static inline void transpose4(float32x4_t * r0, float32x4_t * r1, float32x4_t * r2, float32x4_t * r3)
+{
+	float32x4x2_t t01 = vtrnq_f32(*r0, *r1);
+	float32x4x2_t t23 = vtrnq_f32(*r2, *r3);
+	*r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+	*r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+	*r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	*r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+// interp_hermite from interp.h, for four reads at once: rk holds point k of each, u their positions
+static inline float32x4_t hermite_q(float32x4_t r0, float32x4_t r1, float32x4_t r2, float32x4_t r3, float32x4_t u)
+{
+	float32x4_t c1 = vmulq_n_f32(vsubq_f32(r2, r0), 0.5f);
+	float32x4_t c2 = vfmaq_f32(vfmaq_f32(r0, r2, vdupq_n_f32(2)), r1, vdupq_n_f32(-2.5f));
+	c2 = vfmaq_f32(c2, r3, vdupq_n_f32(-0.5f));
+	float32x4_t c3 = vfmaq_f32(vmulq_n_f32(vsubq_f32(r3, r0), 0.5f), vsubq_f32(r1, r2), vdupq_n_f32(1.5f));
+	float32x4_t y = vfmaq_f32(c2, c3, u);
+	y = vfmaq_f32(c1, y, u);
+	return vfmaq_f32(r1, y, u);
+}
+
+// interp_lagrange3 from interp.h, for four reads at once: rk holds point k of each, u their positions
+static inline float32x4_t lagrange3_q(float32x4_t r0, float32x4_t r1, float32x4_t r2, float32x4_t r3, float32x4_t u)
+{
+	float32x4_t um1 = vsubq_f32(u, vdupq_n_f32(1));
+	float32x4_t um2 = vsubq_f32(u, vdupq_n_f32(2));
+	float32x4_t up1 = vaddq_f32(u, vdupq_n_f32(1));
+	float32x4_t uum1 = vmulq_f32(u, um1);
+	float32x4_t up1um2 = vmulq_f32(up1, um2);
+	float32x4_t h0 = vmulq_n_f32(vmulq_f32(uum1, um2), -1.0f/6);
+	float32x4_t h1 = vmulq_n_f32(vmulq_f32(up1um2, um1), 0.5f);
+	float32x4_t h2 = vmulq_n_f32(vmulq_f32(up1um2, u), -0.5f);
+	float32x4_t h3 = vmulq_n_f32(vmulq_f32(uum1, up1), 1.0f/6);
+	float32x4_t y = vmulq_f32(h0, r0);
+	y = vfmaq_f32(y, h1, r1);
+	y = vfmaq_f32(y, h2, r2);
+	return vfmaq_f32(y, h3, r3);
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "stereodelay.h"
+#include "delay.h"
+#include "denormal.h"
+#include <stdlib.h>
+#include <errno.h>
+
+int stereo_delay_construct(stereo_delay_t * self, unsigned int samplerate, int mode, float msL, float msR, 
+							float feedback, float cross, float mix, float width, const struct bq_filter * filt)
+{
+	if((mode != STEREO_DELAY_DUAL && mode != STEREO_DELAY_PINGPONG) 
+		|| msL < 0 || msL > DELAY_MAX_MS || msR < 0 || msR > DELAY_MAX_MS
+		|| feedback < 0 || feedback > 1 || cross < 0 || cross > 1 
+		|| mix < 0 || mix > 1 || width < 0 || width > 1)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	self->DL = msL * samplerate / 1000;
+	self->DR = msR * samplerate / 1000;
+	if(self->DL < 1) self->DL = 1;
+	if(self->DR < 1) self->DR = 1;
+	unsigned int longest = self->DL > self->DR ? self->DL : self->DR;
+	self->size = 1;
+	while(self->size < longest) self->size <<= 1;
+	self->mask = self->size - 1;
+	self->w = 0;
+	self->buf = calloc(2 * self->size, sizeof(float));
+	if(!self->buf) return -1;
+	
+	if(mode == STEREO_DELAY_PINGPONG) cross = 1;
+	self->mode = mode;
+	self->fb_same = feedback * (1 - cross);
+	self->fb_cross = feedback * cross;
+	self->mix = mix;
+	self->width = width;
+	
+	if(filt)
+	{
+		self->cx[0] = filt->cx0; self->cx[1] = filt->cx1; self->cx[2] = filt->cx2;
+		self->cy[0] = filt->cy1; self->cy[1] = filt->cy2;
+	}
+	else
+	{
+		self->cx[0] = 1; self->cx[1] = 0; self->cx[2] = 0;
+		self->cy[0] = 0; self->cy[1] = 0;
+	}
+	self->s1[0] = self->s1[1] = 0;
+	self->s2[0] = self->s2[1] = 0;
+	return 0;
+}
+
+void stereo_delay_destruct(stereo_delay_t * self)
+{
+	free(self->buf);
+}
+
+void stereo_delay_apply_block(stereo_delay_t * self, float * L, float * R, int n)
+{
+	// lane 0 is left, lane 1 is right
+	float * buf = self->buf;
+	const unsigned int mask = self->mask, DL = self->DL, DR = self->DR;
+	unsigned int w = self->w;
+	const bool pingpong = self->mode == STEREO_DELAY_PINGPONG;
+	
+	const float32x2_t b0 = vdup_n_f32(self->cx[0]), b1 = vdup_n_f32(self->cx[1]), b2 = vdup_n_f32(self->cx[2]);
+	const float32x2_t a1 = vdup_n_f32(-self->cy[0]), a2 = vdup_n_f32(-self->cy[1]);
+	float32x2_t s1 = vld1_f32(self->s1), s2 = vld1_f32(self->s2);
+	
+	// width as a mix of each side with the other: 1 keeps them apart, 0 sums them to mono
+	const float wet_same = self->mix * 0.5f * (1 + self->width);
+	const float wet_cross = self->mix * 0.5f * (1 - self->width);
+	const float fb_same = self->fb_same, fb_cross = self->fb_cross;
+	
+	for(int i = 0; i < n; i++)
+	{
+		float32x2_t e = vdup_n_f32(0);
+		e = vld1_lane_f32(buf + 2 * ((w - DL) & mask), e, 0);
+		e = vld1_lane_f32(buf + 2 * ((w - DR) & mask) + 1, e, 1);
+		float32x2_t er = vrev64_f32(e); // the other side's echo
+		
+		float32x2_t x = vdup_n_f32(0);
+		x = vld1_lane_f32(L + i, x, 0);
+		x = vld1_lane_f32(R + i, x, 1);
+		
+		// what goes into the lines: input plus feedback, through the filter
+		float32x2_t v;
+		if(pingpong)
+			v = vset_lane_f32(0.5f * (L[i] + R[i]), vdup_n_f32(0), 0);
+		else
+			v = x;
+		v = vmla_n_f32(v, e, fb_same);
+		v = vmla_n_f32(v, er, fb_cross);
+		float32x2_t y = vfma_f32(s1, b0, v);
+		s1 = vfma_f32(vfma_f32(s2, b1, v), a1, y);
+		s2 = vfma_f32(vmul_f32(b2, v), a2, y);
+		vst1_f32(buf + 2 * (w & mask), denormal_flush2(y));
+		w++;
+		
+		float32x2_t out = vmla_n_f32(vmla_n_f32(x, e, wet_same), er, wet_cross);
+		vst1_lane_f32(L + i, out, 0);
+		vst1_lane_f32(R + i, out, 1);
+	}
+	
+	self->w = w;
+	vst1_f32(self->s1, denormal_flush2(s1));
+	vst1_f32(self->s2, denormal_flush2(s2));
+}
@@ -0,0 +1,61 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef STEREODELAY_H
+#define STEREODELAY_H
+
+// This file and the associated .c contain a stereo delay: separate left and right delay lines whose feedback 
+// can cross over to the other side (ping-pong), with a stereo width control.
+// The two lines are interleaved in one buffer and processed together as the two lanes of a SIMD vector, 
+// including the feedback filter, so a stereo delay costs about the same as a mono one.
+
+#include "biquad_filt.h"
+#include <stdbool.h>
+
+#define STEREO_DELAY_DUAL 0 // each side's input feeds its own line (cross sets how much feedback goes across)
+#define STEREO_DELAY_PINGPONG 1 // the input (both sides, mixed) goes into the left line only, and all the feedback crosses over, so the echoes bounce from side to side
+
+typedef struct stereo_delay
+{
+	float * buf; // interleaved L/R frames
+	unsigned int size; // frames, power of two
+	unsigned int mask;
+	unsigned int w; // next frame written
+	unsigned int DL, DR; // delays in samples
+	
+	int mode;
+	float fb_same, fb_cross; // feedback to the same side and across
+	float mix; // 0 to 1
+	float width; // 0 (mono echoes) to 1 (full stereo)
+	
+	float cx[3], cy[2]; // feedback filter coefficients (shared by both sides)
+	float s1[2], s2[2]; // feedback filter state, per side
+} stereo_delay_t;
+
+// msL, msR: delay times (up to DELAY_MAX_MS from delay.h)
+// feedback, cross, mix and width are 0 to 1. cross is ignored in ping-pong mode.
+// filt: filter for the feedback path, or NULL (its coefficients are copied).
+// returns 0 if ok, -1 and sets errno on an error.
+int stereo_delay_construct(stereo_delay_t * self, unsigned int samplerate, int mode, float msL, float msR, 
+							float feedback, float cross, float mix, float width, const struct bq_filter * filt);
+
+void stereo_delay_destruct(stereo_delay_t * self);
+
+// process n frames of stereo, in place
+void stereo_delay_apply_block(stereo_delay_t * self, float * L, float * R, int n);
+
+#endif
@@ -0,0 +1,136 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "svf.h"
+#include "biquad_filt.h"
+#include "denormal.h"
+#include <errno.h>
+#include <math.h>
+
+int svf_design(struct svf_coefs * output, int type, float freq, float sample_rate, float Q, float gain_db)
+{
+	if(Q <= 0 || freq <= 0 || freq >= sample_rate / 2)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	double g = tan(M_PI * freq / sample_rate);
+	double k = 1.0 / Q;
+	double A = pow(10.0, gain_db / 40.0);
+	double m0 = 0, m1 = 0, m2 = 0;
+	
+	switch(type)
+	{
+		case BQ_LOWPASS:
+			m2 = 1;
+			break;
+		case BQ_HIGHPASS:
+			m0 = 1; m1 = -k; m2 = -1;
+			break;
+		case BQ_BANDPASS: // unity gain at the centre, like make_biquad's
+			m1 = k;
+			break;
+		case BQ_NOTCH:
+			m0 = 1; m1 = -k;
+			break;
+		case BQ_PEAK:
+			k = 1.0 / (Q * A);
+			m0 = 1; m1 = k * (A * A - 1);
+			break;
+		case BQ_LOWSHELF:
+			g /= sqrt(A);
+			m0 = 1; m1 = k * (A - 1); m2 = A * A - 1;
+			break;
+		case BQ_HIGHSHELF:
+			g *= sqrt(A);
+			m0 = A * A; m1 = k * (1 - A) * A; m2 = 1 - A * A;
+			break;
+		default:
+			errno = EINVAL;
+			return -1;
+	}
+	
+	double a1 = 1.0 / (1.0 + g * (g + k));
+	output->a1 = a1;
+	output->a2 = g * a1;
+	output->a3 = g * g * a1;
+	output->m0 = m0;
+	output->m1 = m1;
+	output->m2 = m2;
+	return 0;
+}
+
+int svf_construct(svf_t * self, int type, float freq, float sample_rate, float Q, float gain_db)
+{
+	if(-1 == svf_design(&self->cur, type, freq, sample_rate, Q, gain_db))
+		return -1;
+	tbuf_init(&self->tb);
+	self->slots[tbuf_read_slot(&self->tb)] = self->cur;
+	self->ic1eq = 0;
+	self->ic2eq = 0;
+	self->samplerate = sample_rate;
+	return 0;
+}
+
+int svf_set(svf_t * self, int type, float freq, float Q, float gain_db)
+{
+	if(-1 == svf_design(&self->slots[tbuf_write_slot(&self->tb)], type, freq, self->samplerate, Q, gain_db))
+		return -1;
+	tbuf_publish(&self->tb);
+	return 0;
+}
+
+void svf_apply_block(svf_t * self, const float * in, float * out, int n)
+{
+	// an empty block must leave any freshly published coefficients for the next one to ramp to
+	if(n <= 0)
+		return;
+	
+	struct svf_coefs c = self->cur;
+	struct svf_coefs d = {0};
+	if(tbuf_update(&self->tb))
+	{
+		// per-sample increments that land exactly on the new coefficients at the end of the block
+		const struct svf_coefs * t = &self->slots[tbuf_read_slot(&self->tb)];
+		float r = 1.0f / n;
+		d.a1 = (t->a1 - c.a1) * r;
+		d.a2 = (t->a2 - c.a2) * r;
+		d.a3 = (t->a3 - c.a3) * r;
+		d.m0 = (t->m0 - c.m0) * r;
+		d.m1 = (t->m1 - c.m1) * r;
+		d.m2 = (t->m2 - c.m2) * r;
+		self->cur = *t;
+	}
+	
+	float ic1eq = self->ic1eq, ic2eq = self->ic2eq;
+	for(int i = 0; i < n; i++)
+	{
+		c.a1 += d.a1; c.a2 += d.a2; c.a3 += d.a3;
+		c.m0 += d.m0; c.m1 += d.m1; c.m2 += d.m2;
+		
+		float v0 = in[i];
+		float v3 = v0 - ic2eq;
+		float v1 = c.a1 * ic1eq + c.a2 * v3;
+		float v2 = ic2eq + c.a2 * ic1eq + c.a3 * v3;
+		ic1eq = 2 * v1 - ic1eq;
+		ic2eq = 2 * v2 - ic2eq;
+		out[i] = c.m0 * v0 + c.m1 * v1 + c.m2 * v2;
+	}
+	self->ic1eq = denormal_flush(ic1eq);
+	self->ic2eq = denormal_flush(ic2eq);
+}
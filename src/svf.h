@@ -0,0 +1,56 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef SVF_H
+#define SVF_H
+
+// This file and the associated .c contain a state variable filter (the trapezoidal SVF described by Andrew Simper, Cytomic).
+// It produces the same responses as the biquads, but its state stays meaningful when the coefficients change, 
+// so it can be swept (e.g. by a control thread, or an LFO) without clicks or instability.
+// New coefficients are published from another thread with svf_set, and the audio thread ramps to them over one block.
+
+#include "tbuf.h"
+
+struct svf_coefs
+{
+	float a1, a2, a3; // filter
+	float m0, m1, m2; // output mix of input, bandpass and lowpass
+};
+
+typedef struct svf
+{
+	struct svf_coefs cur; // coefficients in use (audio thread only)
+	struct svf_coefs slots[3]; // handed over by tb
+	tbuf_t tb;
+	float ic1eq, ic2eq; // state
+	float samplerate;
+} svf_t;
+
+// type is one of the BQ_ constants from biquad_filt.h. gain_db is only used by BQ_PEAK, BQ_LOWSHELF and BQ_HIGHSHELF.
+// returns 0 if ok, -1 and sets errno (EINVAL) on an error.
+int svf_design(struct svf_coefs * output, int type, float freq, float sample_rate, float Q, float gain_db);
+
+int svf_construct(svf_t * self, int type, float freq, float sample_rate, float Q, float gain_db);
+
+// change the filter. Called from one control thread at a time (not the audio thread); never blocks.
+int svf_set(svf_t * self, int type, float freq, float Q, float gain_db);
+
+// filter n samples. in and out may be the same buffer. If svf_set has been called since the last block, 
+// the coefficients move linearly to the new ones over this block.
+void svf_apply_block(svf_t * self, const float * in, float * out, int n);
+
+#endif
@@ -0,0 +1,74 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TBUF_H
+#define TBUF_H
+
+// A lock-free triple buffer, for handing parameters (e.g. filter coefficients) from a control thread to the audio thread.
+// The caller owns an array of 3 slots of whatever type it likes; this only manages which slot is which.
+// The writer fills tbuf_write_slot() and calls tbuf_publish(). The reader calls tbuf_update() and then reads 
+// tbuf_read_slot(), which always holds the newest complete set that has been published. Neither side ever waits,
+// and the writer may publish as often as it likes (sets the reader never saw are simply dropped).
+// Exactly one writer thread and one reader thread.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define TBUF_FRESH 4 // flag in middle: the middle slot was published since the reader last took it
+
+typedef struct tbuf
+{
+	unsigned int back; // slot the writer is filling (writer only)
+	atomic_uint middle; // slot index of the last published set, plus TBUF_FRESH
+	unsigned int front; // slot the reader is reading (reader only)
+} tbuf_t;
+
+// initially the reader sees slot 0, so fill that one first if it matters
+static inline void tbuf_init(tbuf_t * self)
+{
+	self->front = 0;
+	atomic_init(&self->middle, 1);
+	self->back = 2;
+}
+
+static inline unsigned int tbuf_write_slot(const tbuf_t * self)
+{
+	return self->back;
+}
+
+static inline void tbuf_publish(tbuf_t * self)
+{
+	unsigned int old = atomic_exchange_explicit(&self->middle, self->back | TBUF_FRESH, memory_order_acq_rel);
+	self->back = old & 3;
+}
+
+// returns true if a new set was published since the last call (and the read slot has changed)
+static inline bool tbuf_update(tbuf_t * self)
+{
+	if(!(atomic_load_explicit(&self->middle, memory_order_relaxed) & TBUF_FRESH))
+		return false;
+	unsigned int old = atomic_exchange_explicit(&self->middle, self->front, memory_order_acq_rel);
+	self->front = old & 3;
+	return true;
+}
+
+static inline unsigned int tbuf_read_slot(const tbuf_t * self)
+{
+	return self->front;
+}
+
+#endif
@@ -0,0 +1,256 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "telemetry.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Linux/POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOAD_ALPHA 0.01f
+
+const char * const stage_names[N_STAGES] = 
+{
+	[STAGE_READ] = "read",
+	[STAGE_CONV] = "convolution",
+	[STAGE_EQ] = "eq",
+	[STAGE_GAIN] = "gain",
+	[STAGE_MODMATRIX] = "modulation",
+	[STAGE_LOWCUT] = "lowcut",
+	[STAGE_WAH] = "wah",
+	[STAGE_TREMOLO] = "tremolo",
+	[STAGE_CHOFLANGE] = "chorus/flange",
+	[STAGE_DELAY] = "delay",
+	[STAGE_LOOPER] = "looper",
+	[STAGE_MULTITAP] = "multitap",
+	[STAGE_ENSEMBLE] = "ensemble",
+	[STAGE_STEREODELAY] = "stereo delay",
+	[STAGE_RESAMPLE] = "resample",
+	[STAGE_WRITE] = "write",
+};
+
+int telemetry_init(telemetry_t * self, uint32_t period_ns, const char * shm_name)
+{
+	memset(self, 0, sizeof(telemetry_t));
+	
+	if(shm_name)
+	{
+		int fd = shm_open(shm_name, O_CREAT | O_RDWR, 0644);
+		if(fd == -1) return -1;
+		if(-1 == ftruncate(fd, sizeof(struct telemetry_stats)))
+		{
+			close(fd);
+			shm_unlink(shm_name);
+			return -1;
+		}
+		void * p = mmap(NULL, sizeof(struct telemetry_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if(p == MAP_FAILED)
+		{
+			shm_unlink(shm_name);
+			return -1;
+		}
+		// the mapping is touched every period by the audio thread. Keep it out of swap.
+		mlock(p, sizeof(struct telemetry_stats));
+		self->stats = p;
+		self->shm_name = shm_name;
+		memset(self->stats, 0, sizeof(struct telemetry_stats)); // a previous run may have left the segment behind
+	}
+	else
+	{
+		self->stats = calloc(1, sizeof(struct telemetry_stats));
+		if(!self->stats) return -1;
+	}
+	
+	self->stats->magic = TELEM_MAGIC;
+	self->stats->version = TELEM_VERSION;
+	self->stats->size = sizeof(struct telemetry_stats);
+	self->stats->n_stages = N_STAGES;
+	for(int i = 0; i < N_STAGES; i++)
+		strncpy(self->stats->stage_names[i], stage_names[i], sizeof(self->stats->stage_names[i]) - 1);
+	
+	self->stats->period_ns = period_ns;
+	self->stats->bucket_ns = 2 * period_ns / TELEM_HIST_BUCKETS;
+	if(self->stats->bucket_ns == 0) self->stats->bucket_ns = 1;
+	
+	self->t_mark = self->t_period = telemetry_now();
+	return 0;
+}
+
+void telemetry_destruct(telemetry_t * self)
+{
+	if(self->shm_name)
+	{
+		munmap(self->stats, sizeof(struct telemetry_stats));
+		shm_unlink(self->shm_name);
+	}
+	else free(self->stats);
+}
+
+const struct telemetry_stats * telemetry_attach(const char * shm_name)
+{
+	int fd = shm_open(shm_name, O_RDONLY, 0);
+	if(fd == -1) return NULL;
+	
+	struct stat st;
+	if(-1 == fstat(fd, &st))
+	{
+		close(fd);
+		return NULL;
+	}
+	if(st.st_size != sizeof(struct telemetry_stats))
+	{
+		close(fd);
+		errno = EPROTO;
+		return NULL;
+	}
+	
+	const struct telemetry_stats * s = mmap(NULL, sizeof(struct telemetry_stats), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(s == MAP_FAILED) return NULL;
+	
+	if(s->magic != TELEM_MAGIC || s->version != TELEM_VERSION || s->size != sizeof(struct telemetry_stats))
+	{
+		telemetry_detach(s);
+		errno = EPROTO;
+		return NULL;
+	}
+	return s;
+}
+
+void telemetry_detach(const struct telemetry_stats * s)
+{
+	munmap((void *) s, sizeof(struct telemetry_stats));
+}
+
+void telemetry_end_period(telemetry_t * self)
+{
+	struct telemetry_stats * s = self->stats;
+	
+	uint64_t dsp = 0;
+	for(int i = 0; i < N_STAGES; i++)
+		if(STAGE_IS_DSP(i)) dsp += self->stage_ns[i];
+	
+	unsigned int bucket = dsp / s->bucket_ns;
+	if(bucket >= TELEM_HIST_BUCKETS) bucket = TELEM_HIST_BUCKETS - 1;
+	
+	// seqlock write side. We are the only writer, so a relaxed load of our own counter is fine.
+	unsigned int seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+	atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	
+	s->periods++;
+	s->ir_len = self->ir_len;
+	s->shed_level = self->shed_level;
+	s->load += LOAD_ALPHA * ((float) dsp / s->period_ns - s->load);
+	s->dsp_ns_last = dsp;
+	s->dsp_ns_total += dsp;
+	if(dsp > s->dsp_ns_worst) s->dsp_ns_worst = dsp;
+	if(dsp > s->period_ns) s->deadline_misses++;
+	s->hist[bucket]++;
+	
+	for(int i = 0; i < N_STAGES; i++)
+	{
+		s->stage_ns_last[i] = self->stage_ns[i];
+		s->stage_ns_total[i] += self->stage_ns[i];
+		if(self->stage_ns[i] > s->stage_ns_worst[i]) s->stage_ns_worst[i] = self->stage_ns[i];
+	}
+	
+	for(unsigned int i = 0; i < self->xruns; i++)
+	{
+		s->xrun_ts[s->xruns % TELEM_XRUN_LOG] = self->xrun_ts;
+		s->xruns++;
+	}
+	
+	atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+	
+	memset(self->stage_ns, 0, sizeof(self->stage_ns));
+	self->xruns = 0;
+	
+	if(self->trace) trace_push(self->trace, TRACE_PERIOD, 0, self->t_period, self->t_mark);
+	self->t_period = self->t_mark;
+}
+
+void telemetry_snapshot(const telemetry_t * self, struct telemetry_stats * out)
+{
+	telemetry_read(self->stats, out);
+}
+
+void telemetry_read(const struct telemetry_stats * s, struct telemetry_stats * out)
+{
+	unsigned int s0, s1;
+	do
+	{
+		s0 = atomic_load_explicit(&s->seq, memory_order_acquire);
+		memcpy(out, s, sizeof(struct telemetry_stats));
+		atomic_thread_fence(memory_order_acquire);
+		s1 = atomic_load_explicit(&s->seq, memory_order_relaxed);
+	} while((s0 & 1) || s0 != s1);
+}
+
+void telemetry_print(const struct telemetry_stats * s, FILE * f)
+{
+	if(s->periods == 0)
+	{
+		fprintf(f, "No periods processed yet.\n");
+		return;
+	}
+	
+	double avg = (double) s->dsp_ns_total / s->periods;
+	fprintf(f, "periods %llu, load %.1f%%, IR %u samples, shed level %u, DSP avg %.1f us (%.1f%%), last %.1f us, worst %.1f us (%.1f%% of the %.1f us period)\n",
+		(unsigned long long) s->periods,
+		100.0 * s->load, s->ir_len, s->shed_level,
+		avg / 1000, 100.0 * avg / s->period_ns,
+		s->dsp_ns_last / 1000.0,
+		s->dsp_ns_worst / 1000.0, 100.0 * s->dsp_ns_worst / s->period_ns,
+		s->period_ns / 1000.0);
+	fprintf(f, "deadline misses %llu, xruns %llu", (unsigned long long) s->deadline_misses, (unsigned long long) s->xruns);
+	if(s->xruns > 0)
+		fprintf(f, " (last at %.3f s)", s->xrun_ts[(s->xruns - 1) % TELEM_XRUN_LOG] / 1e9);
+	fprintf(f, "\n");
+	
+	for(int i = 0; i < N_STAGES; i++)
+	{
+		if(s->stage_ns_total[i] == 0) continue;
+		fprintf(f, "  %-14s avg %8.1f us  worst %8.1f us\n", s->stage_names[i],
+			(double) s->stage_ns_total[i] / s->periods / 1000,
+			s->stage_ns_worst[i] / 1000.0);
+	}
+	
+	// DSP time percentiles from the histogram (upper edge of the bucket)
+	const double pct[] = {0.5, 0.99, 0.999};
+	for(int p = 0; p < 3; p++)
+	{
+		uint64_t want = (uint64_t) (pct[p] * s->periods), seen = 0;
+		int b = 0;
+		for(; b < TELEM_HIST_BUCKETS - 1; b++)
+		{
+			seen += s->hist[b];
+			if(seen > want) break;
+		}
+		if(b == TELEM_HIST_BUCKETS - 1)
+			fprintf(f, "%s p%g > %.1f us", p ? "," : " ", pct[p] * 100, b * s->bucket_ns / 1000.0);
+		else
+			fprintf(f, "%s p%g < %.1f us", p ? "," : " ", pct[p] * 100, (b + 1) * s->bucket_ns / 1000.0);
+	}
+	fprintf(f, "\n");
+}
@@ -0,0 +1,178 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// This file and the associated .c contain timing instrumentation for the realtime loop.
+// 
+// The audio thread marks the end of each stage of the loop (read, each effect, write). The elapsed times are 
+// accumulated privately during the period and published once at the end of it, under a seqlock, so that 
+// other threads can take a consistent snapshot at any time without ever blocking the audio thread.
+// Nothing here allocates, locks or does I/O once telemetry_init has returned.
+//
+// The statistics can be placed in a POSIX shared memory segment, so that a separate process (tools/dspstat.c)
+// can monitor the engine live. Publishing to shared memory is just stores to mapped memory: no system calls.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "trace.h"
+
+// the stages of the realtime loop that are timed individually.
+enum dsp_stage
+{
+	STAGE_READ, // waiting for and reading the input period
+	STAGE_CONV,
+	STAGE_EQ,
+	STAGE_GAIN,
+	STAGE_MODMATRIX,
+	STAGE_LOWCUT,
+	STAGE_WAH,
+	STAGE_TREMOLO,
+	STAGE_CHOFLANGE,
+	STAGE_DELAY,
+	STAGE_LOOPER,
+	STAGE_MULTITAP,
+	STAGE_ENSEMBLE,
+	STAGE_STEREODELAY,
+	STAGE_RESAMPLE,
+	STAGE_WRITE, // writing the output period (plus drift measurement)
+	N_STAGES
+};
+
+extern const char * const stage_names[N_STAGES];
+
+// true for the stages that make up the "DSP time" of a period (i.e. everything except the audio I/O).
+#define STAGE_IS_DSP(s) ((s) != STAGE_READ && (s) != STAGE_WRITE)
+
+#define TELEM_HIST_BUCKETS 64 // histogram of DSP time per period. Covers 0 to 2x the period; the last bucket also counts everything longer.
+#define TELEM_XRUN_LOG 16 // number of xrun timestamps kept
+
+#define TELEM_SHM_NAME "/guitardsp" // default name of the shared memory segment
+#define TELEM_MAGIC 0x47445350 // "GDSP"
+#define TELEM_VERSION 9 // bump whenever the layout of struct telemetry_stats changes
+
+// The published statistics. All times are in nanoseconds, measured with CLOCK_MONOTONIC_RAW.
+struct telemetry_stats
+{
+	// constant after telemetry_init. Readers in other processes check these before trusting the rest.
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size; // sizeof(struct telemetry_stats)
+	uint32_t n_stages;
+	char stage_names[N_STAGES][16];
+	
+	atomic_uint seq; // seqlock sequence number. Odd while the audio thread is updating the fields below.
+	
+	uint32_t period_ns; // the deadline: duration of one period of audio
+	uint32_t bucket_ns; // width of each histogram bucket
+	uint32_t ir_len; // current impulse response length, in samples
+	uint32_t shed_level; // current degradation level of the overload governor (0 = full quality)
+	float load; // DSP time as a fraction of the period, smoothed over roughly the last 100 periods
+	
+	uint64_t periods; // number of periods processed
+	uint64_t deadline_misses; // periods whose DSP time alone exceeded the period
+	uint64_t xruns; // number of times snd_pcm_recover had to be called
+	uint64_t xrun_ts[TELEM_XRUN_LOG]; // timestamps of the most recent xruns (circular, indexed by xruns % TELEM_XRUN_LOG)
+	
+	uint64_t dsp_ns_last;
+	uint64_t dsp_ns_worst;
+	uint64_t dsp_ns_total;
+	
+	uint64_t stage_ns_last[N_STAGES];
+	uint64_t stage_ns_worst[N_STAGES];
+	uint64_t stage_ns_total[N_STAGES];
+	
+	uint32_t hist[TELEM_HIST_BUCKETS];
+};
+
+typedef struct telemetry
+{
+	struct telemetry_stats * stats; // published statistics
+	const char * shm_name; // name of the shared memory segment they live in, or NULL if they are in private memory
+	
+	uint32_t ir_len; // set by the engine; published with each period
+	uint32_t shed_level; // same
+	trace_t * trace; // if set, every stage and period is also recorded as a trace event
+	
+	// private to the audio thread
+	uint64_t t_mark; // time at which the current stage started
+	uint64_t t_period; // time at which the current period started
+	uint64_t stage_ns[N_STAGES]; // stage times accumulated during the current period
+	unsigned int xruns; // xruns during the current period
+	uint64_t xrun_ts;
+} telemetry_t;
+
+// returns 0 on success, -1 and sets errno on failure.
+// period_ns is the duration of one period, used as the deadline.
+// shm_name: name of the POSIX shared memory segment to publish the statistics in (e.g. TELEM_SHM_NAME), 
+// or NULL to keep them in private memory.
+int telemetry_init(telemetry_t * self, uint32_t period_ns, const char * shm_name);
+
+// also removes the shared memory segment, if any.
+void telemetry_destruct(telemetry_t * self);
+
+// consistent copy of the published statistics. Safe to call from any thread.
+void telemetry_snapshot(const telemetry_t * self, struct telemetry_stats * out);
+
+// same as above, for a reader that has mapped the statistics itself (e.g. from another process).
+void telemetry_read(const struct telemetry_stats * s, struct telemetry_stats * out);
+
+// map an existing shared memory segment read-only (the reader side).
+// returns NULL and sets errno on failure, including EPROTO if the segment's layout doesn't match ours.
+const struct telemetry_stats * telemetry_attach(const char * shm_name);
+void telemetry_detach(const struct telemetry_stats * s);
+
+// print a summary of a snapshot
+void telemetry_print(const struct telemetry_stats * s, FILE * f);
+
+
+// -- audio thread side --
+
+// CLOCK_MONOTONIC_RAW is served from the vDSO, so this doesn't make a system call.
+// (The ARM cycle counter would be cheaper still, but user space access to it has to be enabled by a kernel module.)
+static inline uint64_t telemetry_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// the stage s just finished. Attributes the time since the previous mark to it.
+static inline void telemetry_mark(telemetry_t * self, enum dsp_stage s)
+{
+	uint64_t now = telemetry_now();
+	self->stage_ns[s] += now - self->t_mark;
+	if(self->trace) trace_push(self->trace, TRACE_STAGE, s, self->t_mark, now);
+	self->t_mark = now;
+}
+
+// call whenever snd_pcm_recover is called
+static inline void telemetry_xrun(telemetry_t * self)
+{
+	self->xruns++;
+	self->xrun_ts = telemetry_now();
+	if(self->trace) trace_push(self->trace, TRACE_RECOVER, 0, self->xrun_ts, self->xrun_ts);
+}
+
+// the period is over: publish what was measured during it.
+void telemetry_end_period(telemetry_t * self);
+
+#endif
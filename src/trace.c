@@ -0,0 +1,164 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "trace.h"
+#include "telemetry.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Linux/POSIX
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define TRACE_DRAIN_INTERVAL_US 50000
+#define TRACE_POSTROLL_DRAINS (TRACE_POSTROLL_US / TRACE_DRAIN_INTERVAL_US + 1)
+
+static void write_event(trace_t * self, const struct trace_event * e)
+{
+	double ts = (int64_t) (e->t0 - self->t_origin) / 1000.0; // microseconds (the first stage may have started slightly before the trace did)
+	double dur = e->dur / 1000.0;
+	
+	fprintf(self->f, ",\n");
+	
+	switch(e->kind)
+	{
+		case TRACE_STAGE:
+			fprintf(self->f, "{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+				e->stage < N_STAGES ? stage_names[e->stage] : "?", ts, dur);
+			break;
+		case TRACE_PERIOD:
+			fprintf(self->f, "{\"name\":\"period\",\"cat\":\"period\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}", ts, dur);
+			break;
+		case TRACE_RECOVER:
+			fprintf(self->f, "{\"name\":\"recover\",\"cat\":\"xrun\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":1}", ts);
+			break;
+	}
+}
+
+// write out the events in hist that aren't in the file yet (those that have been overwritten are lost)
+static void dump(trace_t * self)
+{
+	long size = ftell(self->f);
+	if(size < 0 || size >= TRACE_MAX_BYTES)
+	{
+		self->dumps_skipped++;
+		self->hist_written = self->hist_head;
+		return;
+	}
+	uint64_t i = self->hist_written;
+	if(self->hist_head - i > self->hist_mask + 1)
+		i = self->hist_head - (self->hist_mask + 1);
+	for(; i != self->hist_head; i++)
+		write_event(self, &self->hist[i & self->hist_mask]);
+	self->hist_written = self->hist_head;
+	fflush(self->f);
+}
+
+// move the events from the ring to hist, and dump them once the post-roll after an xrun has been collected
+static void drain(trace_t * self)
+{
+	unsigned int head = atomic_load_explicit(&self->head, memory_order_acquire);
+	unsigned int tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+	for(; tail != head; tail++)
+	{
+		const struct trace_event * e = &self->ring[tail & self->mask];
+		self->hist[self->hist_head++ & self->hist_mask] = *e;
+		if(e->kind == TRACE_RECOVER && !self->dump_countdown)
+			self->dump_countdown = TRACE_POSTROLL_DRAINS;
+	}
+	atomic_store_explicit(&self->tail, tail, memory_order_release);
+	
+	if(self->dump_countdown && !--self->dump_countdown)
+		dump(self);
+}
+
+static void * writer_thread(void * arg)
+{
+	trace_t * self = arg;
+	while(!atomic_load(&self->stop))
+	{
+		usleep(TRACE_DRAIN_INTERVAL_US);
+		drain(self);
+	}
+	return NULL;
+}
+
+int trace_start(trace_t * self, const char * filename, unsigned int ring_log2, unsigned int keep)
+{
+	memset(self, 0, sizeof(trace_t));
+	
+	self->mask = (1u << ring_log2) - 1;
+	self->ring = calloc(self->mask + 1, sizeof(struct trace_event));
+	if(!self->ring) return -1;
+	mlock(self->ring, (self->mask + 1) * sizeof(struct trace_event));
+	
+	unsigned int hist_size = 1;
+	while(hist_size < keep) hist_size <<= 1;
+	self->hist_mask = hist_size - 1;
+	self->hist = calloc(hist_size, sizeof(struct trace_event));
+	if(!self->hist)
+	{
+		free(self->ring);
+		return -1;
+	}
+	
+	self->f = fopen(filename, "w");
+	if(!self->f)
+	{
+		free(self->hist);
+		free(self->ring);
+		return -1;
+	}
+	fprintf(self->f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	// metadata event first, so that every following event can be preceded by a comma
+	fprintf(self->f, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"audio\"}}");
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	self->t_origin = (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	
+	atomic_init(&self->head, 0);
+	atomic_init(&self->tail, 0);
+	atomic_init(&self->dropped, 0);
+	atomic_init(&self->stop, false);
+	
+	if(0 != (errno = pthread_create(&self->tid, NULL, writer_thread, self)))
+	{
+		fclose(self->f);
+		free(self->hist);
+		free(self->ring);
+		return -1;
+	}
+	return 0;
+}
+
+void trace_stop(trace_t * self)
+{
+	atomic_store(&self->stop, true);
+	pthread_join(self->tid, NULL);
+	drain(self);
+	dump(self);
+	fprintf(self->f, "\n]}\n");
+	fclose(self->f);
+	free(self->hist);
+	free(self->ring);
+	
+	unsigned int dropped = atomic_load(&self->dropped);
+	if(dropped) printf("Trace: %u events were dropped because the writer fell behind.\n", dropped);
+	if(self->dumps_skipped) printf("Trace: %u dumps of the recent events were skipped because the file reached its size limit.\n", self->dumps_skipped);
+}
@@ -0,0 +1,106 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+// This file and the associated .c record a timeline of the realtime loop, in the Chrome trace event format 
+// (open the output in chrome://tracing or https://ui.perfetto.dev).
+//
+// The audio thread pushes fixed size events (begin time + duration) into a single-producer single-consumer
+// ring buffer; a background thread drains the ring. If the writer falls behind, events are dropped (and counted) 
+// rather than ever making the audio thread wait.
+//
+// It's a flight recorder, so that it can be left on: the writer keeps only the most recent events in memory, 
+// and writes them out shortly after an xrun (so the file shows what led up to it) and at trace_stop. 
+// Nothing is written twice, and the file stops growing once it reaches TRACE_MAX_BYTES.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define TRACE_POSTROLL_US 500000 // how long after an xrun the recent events are written out (so the recovery is in it too)
+#define TRACE_MAX_BYTES (64u << 20) // once the file reaches this size, further dumps are skipped (and counted)
+
+enum trace_kind
+{
+	TRACE_STAGE, // one stage of the loop (see enum dsp_stage in telemetry.h)
+	TRACE_PERIOD, // a whole period, from the end of the previous write to the end of this one
+	TRACE_RECOVER, // snd_pcm_recover was called (instant)
+};
+
+struct trace_event
+{
+	uint64_t t0; // CLOCK_MONOTONIC_RAW, ns
+	uint32_t dur; // ns
+	uint16_t kind;
+	uint16_t stage;
+};
+
+typedef struct trace
+{
+	struct trace_event * ring;
+	unsigned int mask; // ring size - 1
+	
+	// head is only written by the audio thread, tail only by the writer thread. Separate cache lines.
+	_Alignas(64) atomic_uint head;
+	_Alignas(64) atomic_uint tail;
+	atomic_uint dropped;
+	
+	atomic_bool stop;
+	pthread_t tid;
+	
+	// the rest belongs to the writer thread
+	struct trace_event * hist; // the most recent events
+	unsigned int hist_mask; // hist size - 1
+	uint64_t hist_head; // events ever added to hist
+	uint64_t hist_written; // events of hist already in the file
+	int dump_countdown; // drains until the next dump (0 = none pending)
+	unsigned int dumps_skipped; // because the file reached TRACE_MAX_BYTES
+	FILE * f;
+	uint64_t t_origin; // timestamps in the file are relative to this
+} trace_t;
+
+// open filename and start the writer thread. The ring holds 2^ring_log2 events; the writer keeps the 
+// most recent keep events in memory (rounded up to a power of two), for the dumps.
+// returns 0 on success, -1 and sets errno on failure.
+int trace_start(trace_t * self, const char * filename, unsigned int ring_log2, unsigned int keep);
+
+// write out the recent events still in memory, terminate the JSON and close the file.
+void trace_stop(trace_t * self);
+
+// audio thread side
+static inline void trace_push(trace_t * self, enum trace_kind kind, unsigned int stage, uint64_t t0, uint64_t t1)
+{
+	unsigned int head = atomic_load_explicit(&self->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+	if(head - tail > self->mask)
+	{
+		atomic_fetch_add_explicit(&self->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	struct trace_event * e = &self->ring[head & self->mask];
+	e->t0 = t0;
+	e->dur = t1 - t0;
+	e->kind = kind;
+	e->stage = stage;
+	atomic_store_explicit(&self->head, head + 1, memory_order_release);
+}
+
+#endif
@@ -16,37 +16,13 @@
 	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "tremolo.h"
+#include <stdlib.h>
 #include <math.h>
 #include <errno.h>
+#include <stdbool.h>
 
 
 
-lfo_t lfo(unsigned int samplerate, float freq_hz)
-{
-	lfo_t self;
-	self.omega = freq_hz * 2 * M_PI / samplerate;
-	self.t = 0;
-	return self;
-}
-
-float lfo_next(lfo_t * self)
-{
-	float val = sinf(self->omega * self->t);
-	self->t++;
-	if(self->t * self->omega >= 2 * M_PI) self->t = 0;
-	return val;
-}
-
-
-float lfo_next_tri(lfo_t * self)
-{
-	float val = 2 / M_PI * asinf(sinf(self->omega * self->t));
-	self->t++;
-	if(self->t * self->omega >= 2 * M_PI) self->t = 0;
-	return val;
-}
-
-
 int tremolo_construct(tremolo_t * self, unsigned int samplerate, float depth, lfo_t lfo)
 {
 	if(depth < 0 || depth > 1 )
@@ -57,6 +33,9 @@ int tremolo_construct(tremolo_t * self, unsigned int samplerate, float depth, lf
 	
 	self->lfo = lfo;
 	self->depth = depth;
+	self->depth_mod = NULL;
+	self->samplerate = samplerate;
+	self->mode = TREM_CLASSIC;
 	
 	return 0;
 }
@@ -66,3 +45,114 @@ float tremolo_apply(tremolo_t * self, float sample)
 	float c = 1.0 - 0.5*(self->depth * lfo_next(&self->lfo) + self->depth);
 	return c * sample;
 }
+
+int tremolo_set_mode(tremolo_t * self, int mode)
+{
+	if(mode != TREM_CLASSIC && mode != TREM_HARMONIC && mode != TREM_AUTOPAN)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	if(mode == TREM_HARMONIC && self->mode != TREM_HARMONIC)
+	{
+		// fourth order Linkwitz-Riley: each band is two second order Butterworth sections, and the bands add up flat
+		struct bq_filter f[4];
+		if(-1 == make_biquad(&f[0], BQ_LOWPASS, TREM_XOVER_HZ, self->samplerate, 0.707)
+			|| -1 == make_biquad(&f[1], BQ_HIGHPASS, TREM_XOVER_HZ, self->samplerate, 0.707))
+			return -1;
+		f[2] = f[0];
+		f[3] = f[1];
+		make_biquad_bank(&self->xover[0], f, 4);
+		make_biquad_bank(&self->xover[1], f, 4);
+	}
+	self->mode = mode;
+	return 0;
+}
+
+// the gains for the next m samples: ga follows the LFO down, gb goes the opposite way (for the other band or side)
+static void tremolo_gains(tremolo_t * self, float * ga, float * gb, int m, const float * depth_mod)
+{
+	float l[TREM_BLOCK_MAX];
+	lfo_block(&self->lfo, l, m);
+	for(int j = 0; j < m; j++)
+	{
+		float h = 0.5f * (depth_mod ? depth_mod[j] : self->depth);
+		ga[j] = 1 - h - h * l[j];
+		if(gb) gb[j] = 1 - h + h * l[j];
+	}
+}
+
+void tremolo_apply_block(tremolo_t * self, float * buf, int n)
+{
+	float ga[TREM_BLOCK_MAX], gb[TREM_BLOCK_MAX];
+	float lo[TREM_BLOCK_MAX], hi[TREM_BLOCK_MAX];
+	const bool harmonic = self->mode == TREM_HARMONIC;
+	
+	for(int i = 0; i < n; )
+	{
+		int m = n - i < TREM_BLOCK_MAX ? n - i : TREM_BLOCK_MAX;
+		float * x = buf + i;
+		tremolo_gains(self, ga, harmonic ? gb : NULL, m, self->depth_mod ? self->depth_mod + i : NULL);
+		i += m;
+		
+		if(harmonic)
+		{
+			float * const bands[4] = {lo, hi, NULL, NULL};
+			apply_biquad_bank_split(&self->xover[0], x, bands, m);
+			apply_biquad_bank(&self->xover[1], (const float * const *) bands, bands, m);
+			for(int j = 0; j < m; j++)
+				x[j] = ga[j] * lo[j] + gb[j] * hi[j];
+		}
+		else
+		{
+			for(int j = 0; j < m; j++)
+				x[j] *= ga[j];
+		}
+	}
+}
+
+void tremolo_apply_stereo(tremolo_t * self, float * L, float * R, int n)
+{
+	float ga[TREM_BLOCK_MAX], gb[TREM_BLOCK_MAX];
+	float loL[TREM_BLOCK_MAX], hiL[TREM_BLOCK_MAX], loR[TREM_BLOCK_MAX], hiR[TREM_BLOCK_MAX];
+	
+	for(int i = 0; i < n; )
+	{
+		int m = n - i < TREM_BLOCK_MAX ? n - i : TREM_BLOCK_MAX;
+		float * l = L + i;
+		float * r = R + i;
+		tremolo_gains(self, ga, self->mode == TREM_CLASSIC ? NULL : gb, m, self->depth_mod ? self->depth_mod + i : NULL);
+		i += m;
+		
+		if(self->mode == TREM_HARMONIC)
+		{
+			const float * const in[4] = {l, l, r, r};
+			float * const bands[4] = {loL, hiL, loR, hiR};
+			apply_biquad_bank(&self->xover[0], in, bands, m);
+			apply_biquad_bank(&self->xover[1], (const float * const *) bands, bands, m);
+			for(int j = 0; j < m; j++)
+			{
+				l[j] = ga[j] * loL[j] + gb[j] * hiL[j];
+				r[j] = ga[j] * loR[j] + gb[j] * hiR[j];
+			}
+		}
+		else if(self->mode == TREM_AUTOPAN)
+		{
+			// (the sides trade places: at full depth each goes from silent to full, and their sum stays the same)
+			for(int j = 0; j < m; j++)
+			{
+				l[j] *= ga[j];
+				r[j] *= gb[j];
+			}
+		}
+		else
+		{
+			for(int j = 0; j < m; j++)
+			{
+				l[j] *= ga[j];
+				r[j] *= ga[j];
+			}
+		}
+	}
+}
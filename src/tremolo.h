@@ -19,26 +19,32 @@
 #ifndef TREMOLO_H
 #define TREMOLO_H
 
-// This file and the associated .c contain a simple implemenation of a tremolo effect, and a low-frequency oscillator (LFO) implementation.
-
-typedef struct lfo
-{
-	float omega; // angular frequency divided by sample rate
-	unsigned int t; // current sample number
-} lfo_t;
-
-lfo_t lfo(unsigned int samplerate, float freq_hz); // lfo constructor
-float lfo_next(lfo_t * self); // get next value from the LFO (called every interval of the sample rate). sinusoidal.
-float lfo_next_tri(lfo_t * self); // same as above but triangle wave.
-
+// This file and the associated .c contain a tremolo effect, in three flavours:
+//	classic - the volume goes up and down
+//	harmonic - the signal is split in two bands by a crossover, and the LFO turns one band up while it turns the 
+//		other down, so the tone swirls more than the volume changes (as in some old amps)
+//	auto-pan - the signal moves between the left and right sides (stereo only)
+// The block functions take the LFO a block at a time (lfo_block), and run the crossover as a biquad bank, 
+// the low and high pass of both sides in the four lanes.
 
+#include "lfo.h"
+#include "biquad_filt.h"
 
+#define TREM_CLASSIC 0
+#define TREM_HARMONIC 1
+#define TREM_AUTOPAN 2
 
+#define TREM_BLOCK_MAX 256 // the block functions work in chunks of up to this many samples
+#define TREM_XOVER_HZ 800.0 // crossover frequency of the harmonic tremolo
 
 typedef struct tremolo
 {
 	lfo_t lfo; // tremolo oscillator
 	float depth; // depth of amplitude oscillation.
+	const float * depth_mod; // modulation port (see modmatrix.h): per-sample depth for the block functions, or NULL to use depth
+	int mode; // TREM_ constant
+	bq_bank_t xover[2]; // harmonic mode: the two stages of a Linkwitz-Riley crossover. Lanes: low L, high L, low R, high R.
+	unsigned int samplerate;
 } tremolo_t;
 
 
@@ -49,4 +55,13 @@ int tremolo_construct(tremolo_t * self, unsigned int samplerate, float depth, lf
 
 float tremolo_apply(tremolo_t * self, float sample);
 
+// choose the TREM_ mode (classic by default). returns 0 if ok, -1 and sets errno (EINVAL) for an unknown mode.
+int tremolo_set_mode(tremolo_t * self, int mode);
+
+// process n samples in place (mono). TREM_AUTOPAN needs two sides, so here it works like TREM_CLASSIC.
+void tremolo_apply_block(tremolo_t * self, float * buf, int n);
+
+// process n frames of stereo in place, in any mode
+void tremolo_apply_stereo(tremolo_t * self, float * L, float * R, int n);
+
 #endif
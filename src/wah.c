@@ -0,0 +1,94 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "wah.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#define WAH_ATTACK_MS 5.0
+#define WAH_RELEASE_MS 120.0
+
+int wah_construct(wah_t * self, unsigned int samplerate, int mode, float lfo_hz)
+{
+	if(mode != WAH_FIXED && mode != WAH_LFO && mode != WAH_ENVELOPE)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	
+	self->lut = malloc(sizeof(bq_lut_t));
+	if(!self->lut) return -1;
+	if(-1 == make_biquad_lut(self->lut, BQ_BANDPASS, samplerate, WAH_FMIN, WAH_FMAX, WAH_QMIN, WAH_QMAX, 0))
+	{
+		free(self->lut);
+		return -1;
+	}
+	
+	self->mode = mode;
+	self->position = 0.5;
+	self->resonance = 0.5;
+	self->mix = 1.0;
+	// one LFO step per control block
+	self->lfo = lfo(samplerate, lfo_hz * WAH_BLOCK);
+	self->depth = 0.5;
+	self->env = 0;
+	self->attack = 1 - expf(-1000.0 / (WAH_ATTACK_MS * samplerate));
+	self->release = 1 - expf(-1000.0 / (WAH_RELEASE_MS * samplerate));
+	self->sensitivity = 4.0;
+	
+	self->filt = (struct bq_filter) {0};
+	biquad_lut_set(self->lut, &self->filt, self->position, self->resonance);
+	return 0;
+}
+
+void wah_apply_block(wah_t * self, float * buf, int n)
+{
+	for(int i = 0; i < n; i += WAH_BLOCK)
+	{
+		int m = n - i < WAH_BLOCK ? n - i : WAH_BLOCK;
+		float * x = buf + i;
+		
+		float pos = self->position;
+		if(self->mode == WAH_LFO)
+		{
+			pos += self->depth * lfo_next(&self->lfo);
+		}
+		else if(self->mode == WAH_ENVELOPE)
+		{
+			float env = self->env;
+			for(int j = 0; j < m; j++)
+			{
+				float a = fabsf(x[j]);
+				env += (a > env ? self->attack : self->release) * (a - env);
+			}
+			self->env = env;
+			pos = self->sensitivity * env;
+		}
+		biquad_lut_set(self->lut, &self->filt, pos, self->resonance);
+		
+		float wet[WAH_BLOCK];
+		apply_biquad_block(&self->filt, x, wet, m);
+		for(int j = 0; j < m; j++)
+			x[j] += self->mix * (wet[j] - x[j]);
+	}
+}
+
+void wah_destruct(wah_t * self)
+{
+	free(self->lut);
+}
@@ -0,0 +1,65 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef WAH_H
+#define WAH_H
+
+// This file and the associated .c contain a wah effect: a resonant bandpass filter swept across the midrange.
+// The sweep can be set directly (a pedal), by an LFO (auto-wah) or by the loudness of the playing (envelope filter).
+// The filter is updated every WAH_BLOCK samples from a coefficient table, so sweeping it is cheap.
+
+#include "biquad_filt.h"
+#include "tremolo.h"
+
+#define WAH_FIXED 0 // sweep position set by hand (e.g. by an expression pedal)
+#define WAH_LFO 1 // auto-wah
+#define WAH_ENVELOPE 2 // envelope filter: opens up the harder you pick
+
+#define WAH_BLOCK 16 // control rate: samples per filter update
+#define WAH_FMIN 350.0 // sweep range, Hz
+#define WAH_FMAX 2500.0
+#define WAH_QMIN 2.0 // resonance range
+#define WAH_QMAX 12.0
+
+typedef struct wah
+{
+	bq_lut_t * lut;
+	struct bq_filter filt;
+	int mode;
+	
+	float position; // 0 (heel down) to 1 (toe down). For WAH_LFO, the centre of the sweep.
+	float resonance; // 0 to 1
+	float mix; // 0 = dry, 1 = just the filter
+	
+	lfo_t lfo; // runs at the control rate
+	float depth; // for WAH_LFO, how far either side of position to sweep. 0 to 1.
+	
+	float env; // envelope follower
+	float attack, release; // follower coefficients
+	float sensitivity; // envelope to position
+} wah_t;
+
+// mode is one of the above WAH_ constants. lfo_hz is only used with WAH_LFO.
+// returns 0 if ok, -1 and sets errno on an error.
+int wah_construct(wah_t * self, unsigned int samplerate, int mode, float lfo_hz);
+
+// apply to n samples in place
+void wah_apply_block(wah_t * self, float * buf, int n);
+
+void wah_destruct(wah_t * self);
+
+#endif
@@ -0,0 +1,122 @@
+/*	Copyright (C) 2018, 2020 Harris M. Snyder
+
+	This file is part of guitardsp.
+
+	guitardsp is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	guitardsp is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with guitardsp.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// dspstat: live monitor for a running dsp process, in the style of top.
+// Reads the statistics that the engine publishes in shared memory (see src/telemetry.h). 
+// This never writes to the segment, so it can't disturb the audio thread.
+//
+// usage: dspstat [refresh interval in seconds] 
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// Linux/POSIX
+#include <unistd.h>
+
+#include "telemetry.h"
+
+static void show(const struct telemetry_stats * s, const struct telemetry_stats * prev, double interval)
+{
+	double period_us = s->period_ns / 1000.0;
+	
+	// averages over the last refresh interval, from the difference between two snapshots
+	uint64_t dp = s->periods - prev->periods;
+	double recent = dp ? (double) (s->dsp_ns_total - prev->dsp_ns_total) / dp / 1000.0 : 0.0;
+	
+	printf("\033[H\033[2J"); // home, clear screen
+	printf("dspstat - %s, refresh %.1f s\n\n", TELEM_SHM_NAME, interval);
+	printf("load %5.1f%%   period %.1f us   IR %u samples   shed level %u   %.0f periods/s\n", 
+		100.0 * s->load, period_us, s->ir_len, s->shed_level, dp / interval);
+	printf("DSP time: recent avg %.1f us, last %.1f us, worst %.1f us (%.1f%% of period)\n",
+		recent, s->dsp_ns_last / 1000.0, s->dsp_ns_worst / 1000.0, 100.0 * s->dsp_ns_worst / s->period_ns);
+	printf("deadline misses %llu (+%llu)   xruns %llu (+%llu)\n\n",
+		(unsigned long long) s->deadline_misses, (unsigned long long) (s->deadline_misses - prev->deadline_misses),
+		(unsigned long long) s->xruns, (unsigned long long) (s->xruns - prev->xruns));
+	
+	printf("%-16s %10s %8s %10s %10s\n", "STAGE", "AVG us", "%PERIOD", "LAST us", "WORST us");
+	for(int i = 0; i < s->n_stages; i++)
+	{
+		if(s->stage_ns_total[i] == 0) continue;
+		double avg = dp ? (double) (s->stage_ns_total[i] - prev->stage_ns_total[i]) / dp / 1000.0 : 0.0;
+		printf("%-16s %10.1f %7.1f%% %10.1f %10.1f\n", s->stage_names[i], 
+			avg, 100.0 * avg / period_us, s->stage_ns_last[i] / 1000.0, s->stage_ns_worst[i] / 1000.0);
+	}
+	
+	// histogram of DSP time, one row per non-empty bucket
+	printf("\n%-22s %s\n", "DSP TIME", "PERIODS");
+	for(int b = 0; b < TELEM_HIST_BUCKETS; b++)
+	{
+		if(s->hist[b] == 0) continue;
+		if(b == TELEM_HIST_BUCKETS - 1)
+			printf(">= %6.1f us           %u\n", b * s->bucket_ns / 1000.0, s->hist[b]);
+		else
+			printf("%6.1f - %6.1f us     %u\n", b * s->bucket_ns / 1000.0, (b + 1) * s->bucket_ns / 1000.0, s->hist[b]);
+	}
+	
+	if(s->xruns > 0)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		double tnow = now.tv_sec + now.tv_nsec / 1e9;
+		printf("\nrecent xruns (seconds ago):");
+		uint64_t n = s->xruns < TELEM_XRUN_LOG ? s->xruns : TELEM_XRUN_LOG;
+		for(uint64_t i = 0; i < n; i++)
+			printf(" %.1f", tnow - s->xrun_ts[(s->xruns - 1 - i) % TELEM_XRUN_LOG] / 1e9);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char * argv[])
+{
+	double interval = 1.0;
+	if(argc > 1)
+	{
+		interval = strtod(argv[1], NULL);
+		if(interval <= 0)
+		{
+			printf("usage: %s [refresh interval in seconds]\n", argv[0]);
+			exit(1);
+		}
+	}
+	
+	const struct telemetry_stats * shm = telemetry_attach(TELEM_SHM_NAME);
+	if(!shm)
+	{
+		if(errno == EPROTO) printf("The running dsp was built from a different version (statistics layout mismatch).\n");
+		else printf("Couldn't open %s (%s). Is dsp running?\n", TELEM_SHM_NAME, strerror(errno));
+		exit(1);
+	}
+	
+	struct telemetry_stats prev, cur;
+	telemetry_read(shm, &prev);
+	while(1)
+	{
+		usleep(interval * 1e6);
+		telemetry_read(shm, &cur);
+		if(cur.periods < prev.periods) prev = cur; // the engine restarted
+		show(&cur, &prev, interval);
+		prev = cur;
+	}
+	
+	telemetry_detach(shm);
+	return 0;
+}